@@ -0,0 +1,478 @@
+#include <math.h>
+#include <stdlib.h>
+#include "native_runtime.h"
+
+// Numbers longer than this are rejected rather than risk parsing them differently to the Go validator
+#define FIRETAIL_JSON_MAX_NUMBER_LENGTH 63
+
+// Integers with more digits than this may not be represented exactly by a double
+#define FIRETAIL_JSON_MAX_EXACT_INTEGER_DIGITS 15
+
+int FiretailJsonPeek(FiretailJsonScanner *scanner) {
+  while (scanner->position < scanner->end) {
+    unsigned char c = *scanner->position;
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+      return c;
+    }
+    scanner->position++;
+  }
+  return -1;
+}
+
+int FiretailJsonLiteral(FiretailJsonScanner *scanner, const char *literal) {
+  size_t literal_length = strlen(literal);
+  FiretailJsonPeek(scanner);
+  if ((size_t)(scanner->end - scanner->position) < literal_length ||
+      memcmp(scanner->position, literal, literal_length) != 0) {
+    return 0;
+  }
+  scanner->position += literal_length;
+  return 1;
+}
+
+static int FiretailJsonHexDigits(const char *position, unsigned int *value) {
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = position[i];
+    *value <<= 4;
+    if (c >= '0' && c <= '9') {
+      *value |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      *value |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      *value |= c - 'A' + 10;
+    } else {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Returns the length of the well-formed UTF-8 sequence at position, or 0 if it isn't one. Go would replace malformed
+// sequences rather than reject them, which would change the string's length, so they're treated as invalid.
+static size_t FiretailJsonUtf8SequenceLength(const unsigned char *position, const unsigned char *end) {
+  size_t length;
+  unsigned int code_point;
+  if (position[0] >= 0xC2 && position[0] <= 0xDF) {
+    length = 2;
+    code_point = position[0] & 0x1F;
+  } else if (position[0] >= 0xE0 && position[0] <= 0xEF) {
+    length = 3;
+    code_point = position[0] & 0x0F;
+  } else if (position[0] >= 0xF0 && position[0] <= 0xF4) {
+    length = 4;
+    code_point = position[0] & 0x07;
+  } else {
+    return 0;
+  }
+  if ((size_t)(end - position) < length) {
+    return 0;
+  }
+  for (size_t i = 1; i < length; i++) {
+    if ((position[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    code_point = (code_point << 6) | (position[i] & 0x3F);
+  }
+
+  // Reject overlong encodings, surrogates and code points beyond Unicode's range
+  if ((length == 3 && code_point < 0x800) || (length == 4 && code_point < 0x10000) ||
+      (code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF) {
+    return 0;
+  }
+  return length;
+}
+
+int FiretailJsonString(FiretailJsonScanner *scanner, const char **start, size_t *raw_length, size_t *length,
+                       int *escaped) {
+  if (FiretailJsonPeek(scanner) != '"') {
+    return 0;
+  }
+  scanner->position++;
+  *start = scanner->position;
+  *length = 0;
+  *escaped = 0;
+
+  while (scanner->position < scanner->end) {
+    unsigned char c = *scanner->position;
+    if (c == '"') {
+      *raw_length = scanner->position - *start;
+      scanner->position++;
+      return 1;
+    }
+    if (c < 0x20) {
+      return 0;
+    }
+
+    if (c == '\\') {
+      *escaped = 1;
+      if (scanner->end - scanner->position < 2) {
+        return 0;
+      }
+      char escape = scanner->position[1];
+      if (escape == 'u') {
+        unsigned int code_unit;
+        if (scanner->end - scanner->position < 6 || !FiretailJsonHexDigits(scanner->position + 2, &code_unit)) {
+          return 0;
+        }
+        scanner->position += 6;
+
+        // A surrogate pair is one code point. Lone surrogates would be replaced by Go, so they're treated as invalid.
+        if (code_unit >= 0xDC00 && code_unit <= 0xDFFF) {
+          return 0;
+        }
+        if (code_unit >= 0xD800 && code_unit <= 0xDBFF) {
+          unsigned int low_code_unit;
+          if (scanner->end - scanner->position < 6 || scanner->position[0] != '\\' || scanner->position[1] != 'u' ||
+              !FiretailJsonHexDigits(scanner->position + 2, &low_code_unit) || low_code_unit < 0xDC00 ||
+              low_code_unit > 0xDFFF) {
+            return 0;
+          }
+          scanner->position += 6;
+        }
+      } else if (escape == '"' || escape == '\\' || escape == '/' || escape == 'b' || escape == 'f' || escape == 'n' ||
+                 escape == 'r' || escape == 't') {
+        scanner->position += 2;
+      } else {
+        return 0;
+      }
+    } else if (c < 0x80) {
+      scanner->position++;
+    } else {
+      size_t sequence_length = FiretailJsonUtf8SequenceLength((const unsigned char *)scanner->position,
+                                                               (const unsigned char *)scanner->end);
+      if (sequence_length == 0) {
+        return 0;
+      }
+      scanner->position += sequence_length;
+    }
+    (*length)++;
+  }
+
+  return 0;
+}
+
+int FiretailJsonNumber(FiretailJsonScanner *scanner, double *value, int *is_integer) {
+  FiretailJsonPeek(scanner);
+  const char *start = scanner->position;
+  const char *position = start;
+  const char *end = scanner->end;
+  size_t integer_digits = 0;
+
+  if (position < end && *position == '-') {
+    position++;
+  }
+  if (position < end && *position == '0') {
+    position++;
+    integer_digits = 1;
+  } else {
+    while (position < end && *position >= '0' && *position <= '9') {
+      position++;
+      integer_digits++;
+    }
+  }
+  if (integer_digits == 0) {
+    return 0;
+  }
+
+  *is_integer = 1;
+  if (position < end && *position == '.') {
+    *is_integer = 0;
+    position++;
+    const char *fraction_start = position;
+    while (position < end && *position >= '0' && *position <= '9') {
+      position++;
+    }
+    if (position == fraction_start) {
+      return 0;
+    }
+  }
+  if (position < end && (*position == 'e' || *position == 'E')) {
+    *is_integer = 0;
+    position++;
+    if (position < end && (*position == '+' || *position == '-')) {
+      position++;
+    }
+    const char *exponent_start = position;
+    while (position < end && *position >= '0' && *position <= '9') {
+      position++;
+    }
+    if (position == exponent_start) {
+      return 0;
+    }
+  }
+
+  // The body isn't NUL terminated, so the number is copied before it's parsed
+  size_t number_length = position - start;
+  if (number_length > FIRETAIL_JSON_MAX_NUMBER_LENGTH) {
+    return 0;
+  }
+  char number[FIRETAIL_JSON_MAX_NUMBER_LENGTH + 1];
+  memcpy(number, start, number_length);
+  number[number_length] = '\0';
+  *value = strtod(number, NULL);
+
+  // Go can't decode numbers beyond the range of a double
+  if (isinf(*value)) {
+    return 0;
+  }
+  if (integer_digits > FIRETAIL_JSON_MAX_EXACT_INTEGER_DIGITS) {
+    *is_integer = 0;
+  }
+
+  scanner->position = position;
+  return 1;
+}
+
+int FiretailJsonBeginObject(FiretailJsonScanner *scanner) {
+  if (FiretailJsonPeek(scanner) != '{' || scanner->depth >= FIRETAIL_JSON_MAX_DEPTH) {
+    return 0;
+  }
+  scanner->position++;
+  scanner->depth++;
+  return 1;
+}
+
+int FiretailJsonNextMember(FiretailJsonScanner *scanner, int *first, const char **key, size_t *key_length) {
+  int c = FiretailJsonPeek(scanner);
+  if (c == '}') {
+    scanner->position++;
+    scanner->depth--;
+    return 0;
+  }
+  if (!*first) {
+    if (c != ',') {
+      return -1;
+    }
+    scanner->position++;
+  }
+  *first = 0;
+
+  size_t length;
+  int escaped;
+  if (!FiretailJsonString(scanner, key, key_length, &length, &escaped) || escaped) {
+    return -1;
+  }
+  if (FiretailJsonPeek(scanner) != ':') {
+    return -1;
+  }
+  scanner->position++;
+  return 1;
+}
+
+int FiretailJsonBeginArray(FiretailJsonScanner *scanner) {
+  if (FiretailJsonPeek(scanner) != '[' || scanner->depth >= FIRETAIL_JSON_MAX_DEPTH) {
+    return 0;
+  }
+  scanner->position++;
+  scanner->depth++;
+  return 1;
+}
+
+int FiretailJsonNextElement(FiretailJsonScanner *scanner, int *first) {
+  int c = FiretailJsonPeek(scanner);
+  if (c == ']') {
+    scanner->position++;
+    scanner->depth--;
+    return 0;
+  }
+  if (!*first) {
+    if (c != ',') {
+      return -1;
+    }
+    scanner->position++;
+    if (FiretailJsonPeek(scanner) == ']') {
+      return -1;
+    }
+  }
+  *first = 0;
+  return 1;
+}
+
+int FiretailJsonSkipValue(FiretailJsonScanner *scanner) {
+  int c = FiretailJsonPeek(scanner);
+  switch (c) {
+    case '{': {
+      if (!FiretailJsonBeginObject(scanner)) {
+        return 0;
+      }
+      int first = 1, more;
+      const char *key;
+      size_t key_length;
+      while ((more = FiretailJsonNextMember(scanner, &first, &key, &key_length)) > 0) {
+        if (!FiretailJsonSkipValue(scanner)) {
+          return 0;
+        }
+      }
+      return more == 0;
+    }
+    case '[': {
+      if (!FiretailJsonBeginArray(scanner)) {
+        return 0;
+      }
+      int first = 1, more;
+      while ((more = FiretailJsonNextElement(scanner, &first)) > 0) {
+        if (!FiretailJsonSkipValue(scanner)) {
+          return 0;
+        }
+      }
+      return more == 0;
+    }
+    case '"': {
+      const char *start;
+      size_t raw_length, length;
+      int escaped;
+      return FiretailJsonString(scanner, &start, &raw_length, &length, &escaped);
+    }
+    case 't':
+      return FiretailJsonLiteral(scanner, "true");
+    case 'f':
+      return FiretailJsonLiteral(scanner, "false");
+    case 'n':
+      return FiretailJsonLiteral(scanner, "null");
+    default: {
+      double value;
+      int is_integer;
+      return FiretailJsonNumber(scanner, &value, &is_integer);
+    }
+  }
+}
+
+int FiretailJsonSkipNonNullValue(FiretailJsonScanner *scanner) {
+  return FiretailJsonPeek(scanner) != 'n' && FiretailJsonSkipValue(scanner);
+}
+
+// Returns 1 if the Content-Type selects the application/json content as the Go validator finds it, which is by the
+// Content-Type in full or else by what comes before its first ';'. Anything else, even if it only differs in case or
+// whitespace, isn't matched by the Go validator.
+static int FiretailNativeIsJson(const char *content_type, size_t content_type_length) {
+  static const char kJson[] = "application/json";
+  size_t json_length = sizeof(kJson) - 1;
+  return content_type_length >= json_length && memcmp(content_type, kJson, json_length) == 0 &&
+         (content_type_length == json_length || content_type[json_length] == ';');
+}
+
+// Returns 1 if the path matches the operation's path template
+static int FiretailNativePathMatches(const FiretailNativeOperation *operation, const char *path, size_t path_length) {
+  const char *position = path + 1;
+  const char *end = path + path_length;
+  for (size_t i = 0; i < operation->segment_count; i++) {
+    const char *segment_end = memchr(position, '/', end - position);
+    if (segment_end == NULL) {
+      segment_end = end;
+    }
+    size_t segment_length = segment_end - position;
+
+    // Path parameters match any non-empty segment
+    const char *segment = operation->segments[i];
+    if (segment == NULL ? segment_length == 0
+                        : strlen(segment) != segment_length || memcmp(segment, position, segment_length) != 0) {
+      return 0;
+    }
+
+    // Every segment but the last must be followed by a slash, and the last must end the path
+    if (i + 1 < operation->segment_count ? segment_end == end : segment_end != end) {
+      return 0;
+    }
+    position = segment_end + 1;
+  }
+  return 1;
+}
+
+// Finds the operation for the request. If its path matches more than one path template then NULL is returned, as the
+// Go validator's router might choose differently.
+static const FiretailNativeOperation *FiretailNativeFindOperation(const char *method, size_t method_length,
+                                                                  const char *uri, size_t uri_length) {
+  const char *query = memchr(uri, '?', uri_length);
+  size_t path_length = query != NULL ? (size_t)(query - uri) : uri_length;
+  if (path_length == 0 || uri[0] != '/') {
+    return NULL;
+  }
+
+  // The Go validator's router matches the decoded path, so escaped paths are left to it
+  if (memchr(uri, '%', path_length) != NULL) {
+    return NULL;
+  }
+
+  const FiretailNativeOperation *found = NULL;
+  const char *const *matched_segments = NULL;
+  for (size_t i = 0; i < FiretailNativeOperationCount; i++) {
+    const FiretailNativeOperation *operation = &FiretailNativeOperations[i];
+    if (!FiretailNativePathMatches(operation, uri, path_length)) {
+      continue;
+    }
+    if (matched_segments != NULL && matched_segments != operation->segments) {
+      return NULL;
+    }
+    matched_segments = operation->segments;
+    if (strlen(operation->method) == method_length && memcmp(operation->method, method, method_length) == 0) {
+      found = operation;
+    }
+  }
+  return found;
+}
+
+static int FiretailNativeValidateBody(FiretailSchemaValidator validator, const char *body, size_t body_length) {
+  FiretailJsonScanner scanner = {body, body + body_length, 0};
+  if (!validator(&scanner) || FiretailJsonPeek(&scanner) != -1) {
+    return FIRETAIL_NATIVE_INVALID;
+  }
+  return FIRETAIL_NATIVE_VALID;
+}
+
+int FiretailNativeValidateRequest(const char *method, size_t method_length, const char *uri, size_t uri_length,
+                                  const char *content_type, size_t content_type_length, const char *body,
+                                  size_t body_length, const char **operation_id) {
+  const FiretailNativeOperation *operation = FiretailNativeFindOperation(method, method_length, uri, uri_length);
+  if (operation == NULL || !operation->request_covered) {
+    return FIRETAIL_NATIVE_NOT_COVERED;
+  }
+  *operation_id = operation->operation_id;
+
+  if (body_length == 0) {
+    return operation->request_body_required ? FIRETAIL_NATIVE_INVALID : FIRETAIL_NATIVE_VALID;
+  }
+  // Only operations which don't declare a request body have no validator for it, and the Go validator ignores it
+  if (operation->request_body_validator == NULL) {
+    return FIRETAIL_NATIVE_VALID;
+  }
+  if (!FiretailNativeIsJson(content_type, content_type_length)) {
+    return FIRETAIL_NATIVE_NOT_COVERED;
+  }
+  return FiretailNativeValidateBody(operation->request_body_validator, body, body_length);
+}
+
+int FiretailNativeValidateResponse(const char *method, size_t method_length, const char *uri, size_t uri_length,
+                                   int status_code, const char *content_type, size_t content_type_length,
+                                   const char *body, size_t body_length) {
+  const FiretailNativeOperation *operation = FiretailNativeFindOperation(method, method_length, uri, uri_length);
+  if (operation == NULL) {
+    return FIRETAIL_NATIVE_NOT_COVERED;
+  }
+
+  // Find the response for the status code, falling back to the default response
+  const FiretailNativeResponse *response = NULL;
+  for (size_t i = 0; i < operation->response_count; i++) {
+    if (operation->responses[i].status_code == status_code) {
+      response = &operation->responses[i];
+      break;
+    }
+    if (operation->responses[i].status_code == 0) {
+      response = &operation->responses[i];
+    }
+  }
+  if (response == NULL || !response->covered) {
+    return FIRETAIL_NATIVE_NOT_COVERED;
+  }
+
+  if (response->body_validator == NULL) {
+    return FIRETAIL_NATIVE_VALID;
+  }
+  if (!FiretailNativeIsJson(content_type, content_type_length)) {
+    return FIRETAIL_NATIVE_NOT_COVERED;
+  }
+  if (body_length == 0) {
+    return FIRETAIL_NATIVE_INVALID;
+  }
+  return FiretailNativeValidateBody(response->body_validator, body, body_length);
+}
@@ -0,0 +1,90 @@
+#ifndef FIRETAIL_NATIVE_RUNTIME_INCLUDED
+#define FIRETAIL_NATIVE_RUNTIME_INCLUDED
+
+// The runtime shared by every set of generated native validators: a single pass JSON scanner which the generated
+// schema validators drive, and the table of operations they are looked up in. Generated code includes this header.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "../nginx_module/native_validator.h"
+
+// Deeper JSON than this is rejected, so hostile bodies can't exhaust the stack of the generated validators
+#define FIRETAIL_JSON_MAX_DEPTH 64
+
+typedef struct {
+  const char *position;
+  const char *end;
+  int depth;
+} FiretailJsonScanner;
+
+// Validates the JSON value at the scanner's position against one schema, returning 1 if it's valid or 0 if not
+typedef int (*FiretailSchemaValidator)(FiretailJsonScanner *scanner);
+
+// A response defined for an operation. status_code is 0 for the default response.
+typedef struct {
+  int status_code;
+  // 0 if the response uses features the generator can't validate natively
+  int covered;
+  // NULL if the response has no content, in which case its body isn't validated
+  FiretailSchemaValidator body_validator;
+} FiretailNativeResponse;
+
+typedef struct {
+  const char *method;
+  const char *operation_id;
+  // The path's segments, with NULL for segments which are a path parameter
+  const char *const *segments;
+  size_t segment_count;
+  // 0 if the request uses features the generator can't validate natively
+  int request_covered;
+  int request_body_required;
+  // NULL if the operation has no request body, in which case the body isn't validated
+  FiretailSchemaValidator request_body_validator;
+  const FiretailNativeResponse *responses;
+  size_t response_count;
+} FiretailNativeOperation;
+
+// Defined by the generated code
+extern const char FiretailNativeAppspecMd5[];
+extern const FiretailNativeOperation FiretailNativeOperations[];
+extern const size_t FiretailNativeOperationCount;
+
+// Returns the next character after any whitespace without consuming it, or -1 at the end of the input
+int FiretailJsonPeek(FiretailJsonScanner *scanner);
+
+// Consumes the literal (true, false or null), returning 1 if it was found
+int FiretailJsonLiteral(FiretailJsonScanner *scanner, const char *literal);
+
+// Consumes a string. Sets length to its length in code points, and escaped to 1 if it contained escape sequences, in
+// which case start & raw_length give the string as it appears in the JSON rather than its decoded value.
+int FiretailJsonString(FiretailJsonScanner *scanner, const char **start, size_t *raw_length, size_t *length,
+                       int *escaped);
+
+// Consumes a number. Sets is_integer to 1 if it has no fraction or exponent.
+int FiretailJsonNumber(FiretailJsonScanner *scanner, double *value, int *is_integer);
+
+// Consumes any valid JSON value
+int FiretailJsonSkipValue(FiretailJsonScanner *scanner);
+
+// Consumes any valid JSON value except null, as the Go validator only accepts null where a schema is nullable
+int FiretailJsonSkipNonNullValue(FiretailJsonScanner *scanner);
+
+// Consumes an object's opening brace. FiretailJsonNextMember is then called until it returns 0 at the end of the
+// object, each time consuming a member's key so the member's value can be validated. It returns -1 if the object is
+// malformed, or a key contains escape sequences.
+int FiretailJsonBeginObject(FiretailJsonScanner *scanner);
+int FiretailJsonNextMember(FiretailJsonScanner *scanner, int *first, const char **key, size_t *key_length);
+
+// Consumes an array's opening bracket. FiretailJsonNextElement is then called until it returns 0 at the end of the
+// array, each time positioning the scanner at an element so it can be validated. It returns -1 if the array is
+// malformed.
+int FiretailJsonBeginArray(FiretailJsonScanner *scanner);
+int FiretailJsonNextElement(FiretailJsonScanner *scanner, int *first);
+
+// Returns 1 if a key, or an unescaped string, is equal to the given name
+static inline int FiretailJsonKeyEquals(const char *key, size_t key_length, const char *name, size_t name_length) {
+  return key_length == name_length && memcmp(key, name, name_length) == 0;
+}
+
+#endif
@@ -1,22 +1,32 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 #include "access_phase_handler.h"
+#include "capture_policy.h"
 #include "filter_context.h"
 #include "firetail_config.h"
 #include "firetail_module.h"
+#include "native_validation.h"
+#include "validation_batch.h"
 #include <json-c/json.h>
 
 static void FiretailClientBodyHandler(ngx_http_request_t *request);
 static ngx_int_t FiretailClientBodyHandlerInternal(ngx_http_request_t *request);
+static void FiretailResumeRequest(ngx_http_request_t *request);
+static void FiretailRequestValidated(ngx_http_request_t *request, FiretailRequestValidation *validation,
+                                     ReleaseRequest request_releaser);
+static ngx_int_t FiretailApplyRequestValidation(ngx_http_request_t *request, FiretailRequestValidation *validation,
+                                                ReleaseRequest request_releaser);
 static ngx_int_t FiretailReturnFailedValidationResult(ngx_http_request_t *request, ngx_buf_t *b,
                                                       ngx_chain_t *chain_head, char *error);
 
-struct ValidateRequestBody_return {
-  int r0;
-  char *r1;
-};
-typedef struct ValidateRequestBody_return (*ValidateRequestBody)(void *, int, void *, int, void *, int, void *, int,
-                                                                 void *, int);
+// The data for the pool cleanup which releases the validator's handle to the request
+typedef struct {
+  ReleaseRequest request_releaser;
+  uintptr_t request_handle;
+} FiretailRequestHandleCleanup;
+
+static void FiretailReleaseRequestHandle(void *data);
+static void FiretailFreeValidationResponse(void *data);
 
 typedef struct {
   ngx_int_t status;
@@ -59,7 +69,20 @@ ngx_int_t FiretailAccessPhaseHandler(ngx_http_request_t *r) {
 }
 
 static void FiretailClientBodyHandler(ngx_http_request_t *request) {
-  FiretailClientBodyHandlerInternal(request);
+  // If the request has been queued for the Go validator then it's resumed once it's been validated. If it can't be
+  // validated at all then it's rejected rather than passed on unvalidated.
+  ngx_int_t rc = FiretailClientBodyHandlerInternal(request);
+  if (rc == NGX_AGAIN) {
+    return;
+  }
+  if (rc != NGX_OK) {
+    ngx_http_finalize_request(request, NGX_HTTP_INTERNAL_SERVER_ERROR);
+    return;
+  }
+  FiretailResumeRequest(request);
+}
+
+static void FiretailResumeRequest(ngx_http_request_t *request) {
   request->preserve_body = 1;
   request->write_event_handler = ngx_http_core_run_phases;
   ngx_http_core_run_phases(request);
@@ -77,13 +100,26 @@ static ngx_int_t FiretailClientBodyHandlerInternal(ngx_http_request_t *request)
     return NGX_ERROR;
   }
 
-  // get the header values
+  // Get the main config so we can check if we have 404s disabled from the middleware, and apply the capture policy
+  FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
+
+  // get the header values. If a capture policy is set then the headers to be logged are collected in the same pass,
+  // sharing their values with the headers used for validation unless they're redacted
   ngx_list_part_t *part;
   ngx_table_elt_t *h;
   ngx_uint_t i;
   part = &request->headers_in.headers.part;
   h = part->elts;
   json_object *log_root = json_object_new_object();
+  json_object *logged_headers_root = FiretailHeaderPolicyIsSet(main_config) ? json_object_new_object() : NULL;
+  // ctx holds the strings they're serialised to, so they're released with the request
+  if (FiretailPutJsonOnCleanup(request->pool, log_root) != NGX_OK) {
+    json_object_put(logged_headers_root);
+    return NGX_ERROR;
+  }
+  if (logged_headers_root != NULL && FiretailPutJsonOnCleanup(request->pool, logged_headers_root) != NGX_OK) {
+    return NGX_ERROR;
+  }
   for (i = 0;; i++) {
     if (i >= part->nelts) {
       if (part->next == NULL) {
@@ -97,11 +133,31 @@ static ngx_int_t FiretailClientBodyHandlerInternal(ngx_http_request_t *request)
     json_object *array = json_object_new_array();
     json_object_array_add(array, jobj);
     json_object_object_add(log_root, (char *)h[i].key.data, array);
+
+    if (logged_headers_root == NULL || !FiretailHeaderIsLogged(main_config, &h[i].key)) {
+      continue;
+    }
+    json_object *logged_array;
+    if (FiretailHeaderIsRedacted(main_config, &h[i].key)) {
+      logged_array = json_object_new_array();
+      json_object_array_add(logged_array, json_object_new_string(FIRETAIL_REDACTED_HEADER_VALUE));
+    } else {
+      logged_array = json_object_get(array);
+    }
+    json_object_object_add(logged_headers_root, (char *)h[i].key.data, logged_array);
   }
   ctx->request_headers_json = (u_char *)json_object_to_json_string(log_root);
   ctx->request_headers_json_size = strlen((char *)ctx->request_headers_json);
   ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "json value %s", (char *)ctx->request_headers_json);
 
+  if (logged_headers_root != NULL) {
+    ctx->logged_request_headers_json = (u_char *)json_object_to_json_string(logged_headers_root);
+    ctx->logged_request_headers_json_size = strlen((char *)ctx->logged_request_headers_json);
+  } else {
+    ctx->logged_request_headers_json = ctx->request_headers_json;
+    ctx->logged_request_headers_json_size = ctx->request_headers_json_size;
+  }
+
   // Determine the length of the request body chain we've been given
   long new_request_body_parts_size = 0;
   for (ngx_chain_t *current_chain_link = chain_head; current_chain_link != NULL;
@@ -132,36 +188,95 @@ static ngx_int_t FiretailClientBodyHandlerInternal(ngx_http_request_t *request)
   // Update the ctx with the new updated body
   ctx->request_body = updated_request_body;
 
-  // Get the main config so we can check if we have 404s disabled from the middleware
-  FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
-
-  // run the validation
-  void *validator_module = dlopen("/etc/nginx/modules/firetail-validator.so", RTLD_LAZY);
-  if (!validator_module) {
-    return NGX_ERROR;
+  // If the native validators cover the request's operation and find it valid then the Go validator needn't be called.
+  // There's then no handle to the request for the response body filter, so it passes the request to Go itself.
+  uint64_t native_validation_start_usec = FiretailMonotonicUsec();
+  if (FiretailValidateRequestNatively(request, ctx) == NGX_OK) {
+    ctx->request_validation_usec = FiretailMonotonicUsec() - native_validation_start_usec;
+    ctx->request_validated = 1;
+    ctx->verdict = FIRETAIL_VERDICT_PASSED;
+    return NGX_OK;
   }
 
-  ValidateRequestBody request_body_validator = (ValidateRequestBody)dlsym(validator_module, "ValidateRequestBody");
-  char *error;
-  if ((error = dlerror()) != NULL) {
-    ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Failed to load ValidateRequestBody: %s", error);
-    exit(1);
+  // Otherwise it's validated by the Go validator, along with any other requests this worker has read during this
+  // iteration of the event loop
+  return FiretailQueueRequestValidation(request, ctx, FiretailRequestValidated);
+}
+
+static void FiretailRequestValidated(ngx_http_request_t *request, FiretailRequestValidation *validation,
+                                     ReleaseRequest request_releaser) {
+  // If the request was rejected then it's already been finalised, so it mustn't be resumed. If it couldn't be validated
+  // then it's rejected here rather than passed on unvalidated.
+  ngx_int_t rc = FiretailApplyRequestValidation(request, validation, request_releaser);
+  if (rc == NGX_DONE) {
+    return;
+  }
+  if (rc != NGX_OK) {
+    ngx_http_finalize_request(request, NGX_HTTP_INTERNAL_SERVER_ERROR);
+    return;
   }
-  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validating request body...");
+  FiretailResumeRequest(request);
+}
 
-  struct ValidateRequestBody_return validation_result = request_body_validator(
-      main_config->FiretailAllowUndefinedRoutes.data, main_config->FiretailAllowUndefinedRoutes.len, ctx->request_body,
-      ctx->request_body_size, request->unparsed_uri.data, request->unparsed_uri.len, request->method_name.data,
-      request->method_name.len, (char *)ctx->request_headers_json, ctx->request_headers_json_size);
+static ngx_int_t FiretailApplyRequestValidation(ngx_http_request_t *request, FiretailRequestValidation *validation,
+                                                ReleaseRequest request_releaser) {
+  if (validation == NULL) {
+    return NGX_ERROR;
+  }
 
-  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validation request result: %d", validation_result.r0);
-  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validating request body: %s", validation_result.r1);
+  // The response is freed with the request's pool, as a rejected request's is kept in its context and sent after this
+  FiretailFilterContext *ctx = GetFiretailFilterContext(request);
+  ngx_pool_cleanup_t *response_cln = ctx == NULL ? NULL : ngx_pool_cleanup_add(request->pool, 0);
+  if (response_cln == NULL) {
+    ngx_free(validation->response);
+    ngx_free(validation->operation_id);
+    if (validation->request_handle != 0) {
+      request_releaser(validation->request_handle);
+    }
+    return NGX_ERROR;
+  }
+  response_cln->handler = FiretailFreeValidationResponse;
+  response_cln->data = validation->response;
+
+  ctx->request_validated = 1;
+  ctx->verdict = validation->result > 0 ? FIRETAIL_VERDICT_REQUEST_FAILED : FIRETAIL_VERDICT_PASSED;
+
+  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validation request result: %d", validation->result);
+  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validating request body: %s", validation->response);
+
+  // The validator also gives us the operation the request matched, if any, which we copy into the request's pool
+  if (validation->operation_id != NULL) {
+    size_t operation_id_length = ngx_strlen(validation->operation_id);
+    ctx->operation_id.data = ngx_pnalloc(request->pool, operation_id_length);
+    if (ctx->operation_id.data != NULL) {
+      ngx_memcpy(ctx->operation_id.data, validation->operation_id, operation_id_length);
+      ctx->operation_id.len = operation_id_length;
+    }
+    ngx_free(validation->operation_id);
+  }
 
-  // if validation is unsuccessful, return bad request
-  if (validation_result.r0 > 0)
-    return FiretailReturnFailedValidationResult(request, NULL, chain_head, validation_result.r1);
+  // if validation is unsuccessful, return bad request. The request is finalised and NGX_DONE returned.
+  if (validation->result > 0) {
+    if (validation->request_handle != 0) {
+      request_releaser(validation->request_handle);
+    }
+    return FiretailReturnFailedValidationResult(request, NULL, request->request_body->bufs, validation->response);
+  }
 
-  dlclose(validator_module);
+  // The validator keeps the request it parsed for the response body filter to reuse, until the request's pool is
+  // destroyed. Go shared libraries can't be unloaded, so request_releaser is still valid then.
+  if (validation->request_handle != 0) {
+    ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(request->pool, sizeof(FiretailRequestHandleCleanup));
+    if (cln == NULL) {
+      request_releaser(validation->request_handle);
+    } else {
+      FiretailRequestHandleCleanup *cleanup_data = cln->data;
+      cleanup_data->request_releaser = request_releaser;
+      cleanup_data->request_handle = validation->request_handle;
+      cln->handler = FiretailReleaseRequestHandle;
+      ctx->request_handle = validation->request_handle;
+    }
+  }
 
   return NGX_OK;  // can be NGX_DECLINED - see ngx_http_mirror_handler_internal
                   // function in nginx mirror module
@@ -226,6 +341,7 @@ static ngx_int_t FiretailReturnFailedValidationResult(ngx_http_request_t *reques
     rc = ngx_http_output_filter(request, &out);
 
     ngx_http_finalize_request(request, rc);
+    return NGX_DONE;
   }
 
   if (request == request->main) {
@@ -243,3 +359,10 @@ static ngx_int_t FiretailReturnFailedValidationResult(ngx_http_request_t *reques
   ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Sending next REQUEST body", NULL);
   return NGX_OK;
 }
+
+static void FiretailReleaseRequestHandle(void *data) {
+  FiretailRequestHandleCleanup *cleanup_data = data;
+  cleanup_data->request_releaser(cleanup_data->request_handle);
+}
+
+static void FiretailFreeValidationResponse(void *data) { ngx_free(data); }
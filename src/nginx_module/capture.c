@@ -0,0 +1,188 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include "capture.h"
+#include "firetail_module.h"
+
+static FiretailCaptureRecordHeader *FiretailCaptureReserve(struct FiretailCaptureRing *ring, uint64_t record_length,
+                                                           uint64_t *record_offset);
+static void FiretailCaptureUnmap(void *data);
+
+ngx_int_t FiretailCaptureOpen(ngx_conf_t *configuration_object, FiretailConfig *main_config) {
+  if (main_config->FiretailCapturePath.len == 0) {
+    return NGX_OK;
+  }
+
+  // The ring's write offset is advanced with ngx_atomic_cmp_set, so it needs to be the same size as an ngx_atomic_t
+  if (sizeof(ngx_atomic_t) != sizeof(uint64_t)) {
+    ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, 0,
+                       "firetail_capture is only supported on 64-bit platforms");
+    return NGX_ERROR;
+  }
+
+  ngx_str_t *path = &main_config->FiretailCapturePath;
+  if (ngx_conf_full_name(configuration_object->cycle, path, 0) != NGX_OK) {
+    return NGX_ERROR;
+  }
+
+  ngx_fd_t fd = ngx_open_file(path->data, NGX_FILE_RDWR, NGX_FILE_CREATE_OR_OPEN, 0600);
+  if (fd == NGX_INVALID_FILE) {
+    ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, ngx_errno, ngx_open_file_n " \"%s\" failed", path->data);
+    return NGX_ERROR;
+  }
+
+  // If the file already holds a ring, e.g. from before a reload, then its records are kept. Workers from before the
+  // reload may still be writing to it, so it's never resized or reinitialised; if it doesn't match the configuration
+  // then the configuration is refused. Any other file is truncated so the new ring starts out zeroed without having to
+  // write to every page of it.
+  size_t mapping_size = sizeof(FiretailCaptureFileHeader) + main_config->FiretailCaptureSize;
+  FiretailCaptureFileHeader existing_header;
+  ngx_file_info_t file_info;
+  ngx_int_t is_existing_ring =
+      pread(fd, &existing_header, sizeof(existing_header), 0) == (ssize_t)sizeof(existing_header) &&
+      ngx_memcmp(existing_header.magic, FIRETAIL_CAPTURE_FILE_MAGIC, sizeof(existing_header.magic)) == 0;
+  if (is_existing_ring &&
+      (existing_header.version != FIRETAIL_CAPTURE_VERSION ||
+       existing_header.header_size != sizeof(FiretailCaptureFileHeader) ||
+       existing_header.data_size != main_config->FiretailCaptureSize || ngx_fd_info(fd, &file_info) == NGX_FILE_ERROR ||
+       (size_t)ngx_file_size(&file_info) != mapping_size)) {
+    ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, 0,
+                       "\"%s\" holds a capture ring of a different size or version, which may still be in use; "
+                       "remove it or capture to a new file",
+                       path->data);
+    ngx_close_file(fd);
+    return NGX_ERROR;
+  }
+
+  if (!is_existing_ring && (ftruncate(fd, 0) == -1 || ftruncate(fd, mapping_size) == -1)) {
+    ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, ngx_errno, "ftruncate() \"%s\" failed", path->data);
+    ngx_close_file(fd);
+    return NGX_ERROR;
+  }
+
+  void *mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ngx_close_file(fd);
+  if (mapping == MAP_FAILED) {
+    ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, ngx_errno, "mmap() \"%s\" failed", path->data);
+    return NGX_ERROR;
+  }
+
+  struct FiretailCaptureRing *ring = ngx_palloc(configuration_object->pool, sizeof(struct FiretailCaptureRing));
+  ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(configuration_object->pool, 0);
+  if (ring == NULL || cln == NULL) {
+    munmap(mapping, mapping_size);
+    return NGX_ERROR;
+  }
+  ring->header = mapping;
+  ring->data = (u_char *)mapping + sizeof(FiretailCaptureFileHeader);
+  ring->data_size = main_config->FiretailCaptureSize;
+  ring->mapping_size = mapping_size;
+
+  // The mapping is released along with the cycle's configuration, so the old ring is unmapped after a reload
+  cln->handler = FiretailCaptureUnmap;
+  cln->data = ring;
+
+  if (!is_existing_ring) {
+    ngx_memcpy(ring->header->magic, FIRETAIL_CAPTURE_FILE_MAGIC, sizeof(ring->header->magic));
+    ring->header->version = FIRETAIL_CAPTURE_VERSION;
+    ring->header->header_size = sizeof(FiretailCaptureFileHeader);
+    ring->header->data_size = main_config->FiretailCaptureSize;
+    ring->header->write_offset = 0;
+  }
+
+  main_config->FiretailCaptureRing = ring;
+
+  return NGX_OK;
+}
+
+void FiretailCaptureExchange(ngx_http_request_t *request, FiretailFilterContext *ctx) {
+  FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
+  struct FiretailCaptureRing *ring = main_config->FiretailCaptureRing;
+  if (ring == NULL) {
+    return;
+  }
+
+  uint64_t record_length = FIRETAIL_CAPTURE_ALIGN(
+      sizeof(FiretailCaptureRecordHeader) + request->method_name.len + request->unparsed_uri.len +
+      ctx->request_headers_json_size + ctx->request_body_size + ctx->response_headers_json_size +
+      ctx->response_body_size);
+  if (record_length > ring->data_size || record_length > NGX_MAX_UINT32_VALUE) {
+    ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Exchange of %uL bytes is too large to capture",
+                  record_length);
+    return;
+  }
+
+  uint64_t record_offset;
+  FiretailCaptureRecordHeader *record = FiretailCaptureReserve(ring, record_length, &record_offset);
+
+  // Clear the magic before anything else so the record can't be read until it's complete
+  record->magic = 0;
+  ngx_memory_barrier();
+
+  ngx_time_t *now = ngx_timeofday();
+  ngx_msec_int_t request_time =
+      (ngx_msec_int_t)((now->sec - request->start_sec) * 1000 + (now->msec - request->start_msec));
+
+  record->length = (uint32_t)record_length;
+  record->offset = record_offset;
+  record->timestamp_msec = (uint64_t)now->sec * 1000 + now->msec;
+  record->request_time_msec = (uint32_t)ngx_max(request_time, 0);
+  record->status_code = (uint16_t)ctx->status_code;
+  record->unused = 0;
+  record->method_length = request->method_name.len;
+  record->uri_length = request->unparsed_uri.len;
+  record->request_headers_length = ctx->request_headers_json_size;
+  record->request_body_length = ctx->request_body_size;
+  record->response_headers_length = ctx->response_headers_json_size;
+  record->response_body_length = ctx->response_body_size;
+
+  u_char *payload = (u_char *)(record + 1);
+  payload = ngx_cpymem(payload, request->method_name.data, request->method_name.len);
+  payload = ngx_cpymem(payload, request->unparsed_uri.data, request->unparsed_uri.len);
+  payload = ngx_cpymem(payload, ctx->request_headers_json, ctx->request_headers_json_size);
+  payload = ngx_cpymem(payload, ctx->request_body, ctx->request_body_size);
+  payload = ngx_cpymem(payload, ctx->response_headers_json, ctx->response_headers_json_size);
+  ngx_memcpy(payload, ctx->response_body, ctx->response_body_size);
+
+  ngx_memory_barrier();
+  record->magic = FIRETAIL_CAPTURE_RECORD_MAGIC;
+}
+
+static FiretailCaptureRecordHeader *FiretailCaptureReserve(struct FiretailCaptureRing *ring, uint64_t record_length,
+                                                           uint64_t *record_offset) {
+  FiretailCaptureFileHeader *header = ring->header;
+
+  // Other workers may be reserving space at the same time, so retry until our compare and swap wins
+  for (;;) {
+    uint64_t write_offset = header->write_offset;
+    uint64_t position = write_offset % ring->data_size;
+
+    // Records are contiguous, so if this one won't fit before the end of the ring the rest of the ring is skipped
+    uint64_t skipped_length = ring->data_size - position < record_length ? ring->data_size - position : 0;
+
+    if (!ngx_atomic_cmp_set((ngx_atomic_t *)&header->write_offset, write_offset,
+                            write_offset + skipped_length + record_length)) {
+      continue;
+    }
+
+    // Mark any skipped space with a padding record so readers can step over it; if it's too small to hold one, then
+    // readers know to skip it as no record could fit there either
+    if (skipped_length >= sizeof(FiretailCaptureRecordHeader)) {
+      FiretailCaptureRecordHeader *padding = (FiretailCaptureRecordHeader *)(ring->data + position);
+      padding->magic = 0;
+      ngx_memory_barrier();
+      padding->length = (uint32_t)skipped_length;
+      padding->offset = write_offset;
+      ngx_memory_barrier();
+      padding->magic = FIRETAIL_CAPTURE_PADDING_MAGIC;
+    }
+
+    *record_offset = write_offset + skipped_length;
+    return (FiretailCaptureRecordHeader *)(ring->data + *record_offset % ring->data_size);
+  }
+}
+
+static void FiretailCaptureUnmap(void *data) {
+  struct FiretailCaptureRing *ring = data;
+  munmap(ring->header, ring->mapping_size);
+}
@@ -0,0 +1,30 @@
+#ifndef FIRETAIL_CAPTURE_INCLUDED
+#define FIRETAIL_CAPTURE_INCLUDED
+
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include "capture_format.h"
+#include "filter_context.h"
+#include "firetail_config.h"
+
+#define FIRETAIL_CAPTURE_DEFAULT_SIZE (64 * 1024 * 1024)
+#define FIRETAIL_CAPTURE_MIN_SIZE (64 * 1024)
+
+// The memory mapped ring file configured by the firetail_capture directive
+struct FiretailCaptureRing {
+  FiretailCaptureFileHeader *header;
+  u_char *data;
+  // The size of the ring as this process mapped it. The header's data_size is only checked against it when the file is
+  // opened, so a process can never be made to write outside of its mapping by another changing the header.
+  uint64_t data_size;
+  size_t mapping_size;
+};
+
+// Maps the ring file configured by the firetail_capture directive, if there is one. This is done while the
+// configuration is read so the mapping is shared by every worker process.
+ngx_int_t FiretailCaptureOpen(ngx_conf_t *configuration_object, FiretailConfig *main_config);
+
+// Appends the exchange held in ctx to the ring file, if there is one, overwriting the oldest records once it is full
+void FiretailCaptureExchange(ngx_http_request_t *request, FiretailFilterContext *ctx);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef FIRETAIL_CAPTURE_FORMAT_INCLUDED
+#define FIRETAIL_CAPTURE_FORMAT_INCLUDED
+
+// The binary format of the ring file written by the firetail_capture directive. This header is shared with the replay
+// tool so it must only depend upon the C standard library.
+//
+// The file consists of a FiretailCaptureFileHeader followed by a ring of data_size bytes. Records are appended at
+// write_offset % data_size, which only ever increases, and each record is contiguous in the ring; if a record does not
+// fit before the end of the ring, the remaining space is filled with a padding record and the record starts at the
+// beginning of the ring instead. Each record is a FiretailCaptureRecordHeader followed by the method, URI, request
+// headers JSON, request body, response headers JSON and response body, padded to a multiple of 8 bytes. All integers
+// are in the host's byte order.
+
+#include <stdint.h>
+
+#define FIRETAIL_CAPTURE_FILE_MAGIC "FTCAPTUR"
+#define FIRETAIL_CAPTURE_VERSION 1
+#define FIRETAIL_CAPTURE_RECORD_MAGIC 0x52435446   // "FTCR"
+#define FIRETAIL_CAPTURE_PADDING_MAGIC 0x50435446  // "FTCP"
+#define FIRETAIL_CAPTURE_ALIGN(size) (((size) + 7) & ~((uint64_t)7))
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t data_size;
+  // The total number of bytes ever reserved in the ring. Writers advance it with a compare and swap.
+  volatile uint64_t write_offset;
+  uint8_t reserved[32];
+} FiretailCaptureFileHeader;
+
+typedef struct {
+  // Written last, once the rest of the record is complete
+  volatile uint32_t magic;
+  // The length of the record including this header & its padding
+  uint32_t length;
+  // The write_offset the record was written at; records from previous laps of the ring won't match their position
+  uint64_t offset;
+  // When the exchange was captured in milliseconds since the epoch, and how long nginx had spent on it by then
+  uint64_t timestamp_msec;
+  uint32_t request_time_msec;
+  uint16_t status_code;
+  uint16_t unused;
+  uint32_t method_length;
+  uint32_t uri_length;
+  uint32_t request_headers_length;
+  uint32_t request_body_length;
+  uint32_t response_headers_length;
+  uint32_t response_body_length;
+} FiretailCaptureRecordHeader;
+
+#endif
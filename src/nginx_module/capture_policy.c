@@ -0,0 +1,42 @@
+#include <ngx_core.h>
+#include "capture_policy.h"
+
+static ngx_int_t FiretailHeaderListContains(ngx_array_t *header_list, ngx_str_t *header_name) {
+  if (header_list == NULL) {
+    return 0;
+  }
+
+  // Header names are case insensitive
+  ngx_str_t *listed_header_names = header_list->elts;
+  for (ngx_uint_t i = 0; i < header_list->nelts; i++) {
+    if (listed_header_names[i].len == header_name->len &&
+        ngx_strncasecmp(listed_header_names[i].data, header_name->data, header_name->len) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+ngx_int_t FiretailHeaderPolicyIsSet(FiretailConfig *main_config) {
+  return main_config->FiretailLogHeaders != NULL || main_config->FiretailRedactHeaders != NULL;
+}
+
+ngx_int_t FiretailHeaderIsLogged(FiretailConfig *main_config, ngx_str_t *header_name) {
+  // If no allow-list has been configured then every header is logged
+  if (main_config->FiretailLogHeaders == NULL) {
+    return 1;
+  }
+  return FiretailHeaderListContains(main_config->FiretailLogHeaders, header_name);
+}
+
+ngx_int_t FiretailHeaderIsRedacted(FiretailConfig *main_config, ngx_str_t *header_name) {
+  return FiretailHeaderListContains(main_config->FiretailRedactHeaders, header_name);
+}
+
+long FiretailLoggedBodySize(FiretailConfig *main_config, long body_size) {
+  if (main_config->FiretailLogBodyMax == NGX_CONF_UNSET_SIZE || body_size <= (long)main_config->FiretailLogBodyMax) {
+    return body_size;
+  }
+  return (long)main_config->FiretailLogBodyMax;
+}
@@ -0,0 +1,22 @@
+#ifndef FIRETAIL_CAPTURE_POLICY_INCLUDED
+#define FIRETAIL_CAPTURE_POLICY_INCLUDED
+
+#include <ngx_core.h>
+#include "firetail_config.h"
+
+// The value logged in place of any header named by firetail_redact_headers
+#define FIRETAIL_REDACTED_HEADER_VALUE "[REDACTED]"
+
+// Returns 1 if firetail_log_headers or firetail_redact_headers alter which headers are logged, else 0
+ngx_int_t FiretailHeaderPolicyIsSet(FiretailConfig *main_config);
+
+// Returns 1 if the header should be logged according to firetail_log_headers, else 0
+ngx_int_t FiretailHeaderIsLogged(FiretailConfig *main_config, ngx_str_t *header_name);
+
+// Returns 1 if the header's value should be redacted according to firetail_redact_headers, else 0
+ngx_int_t FiretailHeaderIsRedacted(FiretailConfig *main_config, ngx_str_t *header_name);
+
+// Returns the number of bytes of a body of the given size that should be logged according to firetail_log_body_max
+long FiretailLoggedBodySize(FiretailConfig *main_config, long body_size);
+
+#endif
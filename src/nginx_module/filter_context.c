@@ -2,6 +2,8 @@
 #include "filter_context.h"
 #include "firetail_module.h"
 
+static void FiretailPutJson(void *data);
+
 FiretailFilterContext *GetFiretailFilterContext(ngx_http_request_t *request) {
   FiretailFilterContext *ctx = ngx_http_get_module_ctx(request, ngx_firetail_module);
   if (ctx == NULL) {
@@ -13,3 +15,22 @@ FiretailFilterContext *GetFiretailFilterContext(ngx_http_request_t *request) {
   }
   return ctx;
 }
+
+ngx_int_t FiretailPutJsonOnCleanup(ngx_pool_t *pool, json_object *json) {
+  ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(pool, 0);
+  if (cln == NULL) {
+    json_object_put(json);
+    return NGX_ERROR;
+  }
+  cln->handler = FiretailPutJson;
+  cln->data = json;
+  return NGX_OK;
+}
+
+static void FiretailPutJson(void *data) { json_object_put(data); }
+
+uint64_t FiretailMonotonicUsec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
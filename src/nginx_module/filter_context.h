@@ -2,6 +2,7 @@
 #define FIRETAIL_FILTER_CONTEXT_INCLUDED
 
 #include <ngx_http.h>
+#include <json-c/json.h>
 
 // Holds a HTTP header
 typedef struct {
@@ -9,6 +10,14 @@ typedef struct {
   ngx_str_t value;
 } HTTPHeader;
 
+// The outcome of validating an exchange, exposed as $firetail_verdict
+typedef enum {
+  FIRETAIL_VERDICT_NONE = 0,
+  FIRETAIL_VERDICT_PASSED,
+  FIRETAIL_VERDICT_REQUEST_FAILED,
+  FIRETAIL_VERDICT_RESPONSE_FAILED,
+} FiretailVerdict;
+
 // This struct will hold all of the data we will send to Firetail about the
 // request & response bodies & headers
 typedef struct {
@@ -16,17 +25,39 @@ typedef struct {
   long request_body_size;
   long response_body_size;
   long request_headers_json_size;
+  long logged_request_headers_json_size;
+  long response_headers_json_size;
+  long logged_response_headers_json_size;
   u_char *request_body;
   u_char *response_body;
   u_char *request_headers_json;
+  u_char *logged_request_headers_json;  // request_headers_json with the capture policy applied
+  u_char *response_headers_json;
+  u_char *logged_response_headers_json;  // response_headers_json with the capture policy applied
   HTTPHeader *request_headers;
   ngx_uint_t done;
   ngx_uint_t bypass_response;
   u_char *request_result;
+  // Timings & outcomes of validation, exposed as nginx variables
+  FiretailVerdict verdict;
+  ngx_uint_t request_validated;
+  ngx_uint_t response_validated;
+  uint64_t request_validation_usec;
+  uint64_t response_validation_usec;
+  ngx_str_t operation_id;
+  // A cgo.Handle to the request as parsed by ValidateRequestBody, for ValidateResponseBody to reuse. 0 if there's none.
+  uintptr_t request_handle;
 } FiretailFilterContext;
 
 // This utility function will allow us to get the filter ctx whenever we need
 // it, and creates it if it doesn't already exist
 FiretailFilterContext *GetFiretailFilterContext(ngx_http_request_t *request);
 
+// Releases json when pool is destroyed, for JSON whose serialised string is held by the context. If that can't be
+// arranged then json is released straight away and NGX_ERROR returned.
+ngx_int_t FiretailPutJsonOnCleanup(ngx_pool_t *pool, json_object *json);
+
+// Reads the monotonic clock in microseconds, for timing calls to the validator
+uint64_t FiretailMonotonicUsec(void);
+
 #endif
@@ -1,4 +1,6 @@
 #include <ngx_core.h>
+#include <json-c/json.h>
+#include "capture_policy.h"
 #include "filter_context.h"
 #include "filter_headers.h"
 #include "firetail_config.h"
@@ -43,6 +45,55 @@ ngx_int_t FiretailHeaderFilter(ngx_http_request_t *request) {
     }
   }
 
+  // Collect the response headers to be validated. If a capture policy is set then the headers to be logged are
+  // collected in the same pass, sharing their values with the headers used for validation unless they're redacted.
+  FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
+  json_object *response_headers_root = json_object_new_object();
+  json_object *logged_response_headers_root =
+      FiretailHeaderPolicyIsSet(main_config) ? json_object_new_object() : NULL;
+  // ctx holds the strings they're serialised to, so they're released with the request
+  if (FiretailPutJsonOnCleanup(request->pool, response_headers_root) != NGX_OK) {
+    json_object_put(logged_response_headers_root);
+    return NGX_ERROR;
+  }
+  if (logged_response_headers_root != NULL &&
+      FiretailPutJsonOnCleanup(request->pool, logged_response_headers_root) != NGX_OK) {
+    return NGX_ERROR;
+  }
+  for (ngx_list_part_t *response_header_list_part = &request->headers_out.headers.part;
+       response_header_list_part != NULL; response_header_list_part = response_header_list_part->next) {
+    for (ngx_table_elt_t *response_header = response_header_list_part->elts;
+         (ngx_uint_t)response_header <
+         (ngx_uint_t)response_header_list_part->elts + response_header_list_part->nelts * sizeof(ngx_table_elt_t);
+         response_header++) {
+      json_object *value = json_object_new_string((char *)response_header->value.data);
+      json_object_object_add(response_headers_root, (char *)response_header->key.data, value);
+
+      if (logged_response_headers_root == NULL || !FiretailHeaderIsLogged(main_config, &response_header->key)) {
+        continue;
+      }
+      json_object_object_add(logged_response_headers_root, (char *)response_header->key.data,
+                             FiretailHeaderIsRedacted(main_config, &response_header->key)
+                                 ? json_object_new_string(FIRETAIL_REDACTED_HEADER_VALUE)
+                                 : json_object_get(value));
+    }
+  }
+  // Don't forget to add the Content-Type; NGINX doesn't keep it in `headers_out.headers` - it gets special treatment.
+  // It's always logged as the response body can't be validated without it.
+  json_object *content_type = json_object_new_string((char *)request->headers_out.content_type.data);
+  json_object_object_add(response_headers_root, (char *)"Content-Type", content_type);
+  ctx->response_headers_json = (u_char *)json_object_to_json_string(response_headers_root);
+  ctx->response_headers_json_size = strlen((char *)ctx->response_headers_json);
+
+  if (logged_response_headers_root != NULL) {
+    json_object_object_add(logged_response_headers_root, (char *)"Content-Type", json_object_get(content_type));
+    ctx->logged_response_headers_json = (u_char *)json_object_to_json_string(logged_response_headers_root);
+    ctx->logged_response_headers_json_size = strlen((char *)ctx->logged_response_headers_json);
+  } else {
+    ctx->logged_response_headers_json = ctx->response_headers_json;
+    ctx->logged_response_headers_json_size = ctx->response_headers_json_size;
+  }
+
   request->main_filter_need_in_memory = 1;
   request->allow_ranges = 0;
 
@@ -1,18 +1,22 @@
 #include <ngx_core.h>
 #include <curl/curl.h>
 #include <json-c/json.h>
+#include "capture.h"
+#include "capture_policy.h"
 #include "filter_context.h"
 #include "filter_response_body.h"
 #include "firetail_config.h"
 #include "firetail_module.h"
+#include "native_validation.h"
 
 struct ValidateResponseBody_return {
   int r0;
   char *r1;
 };
-typedef struct ValidateResponseBody_return (*ValidateResponseBody)(char *, int, char *, int, char *, int, char *, int,
-                                                                   char *, int, void *, int, char *, int, void *, int,
-                                                                   int, void *, int);
+typedef struct ValidateResponseBody_return (*ValidateResponseBody)(char *, int, char *, int, char *, int, uintptr_t,
+                                                                   void *, int, char *, int, void *, int, int, char *,
+                                                                   int, char *, int, void *, int, int, void *, int,
+                                                                   int);
 
 static ngx_buf_t *FiretailResponseBodyFilterBuffer(ngx_http_request_t *request, u_char *response);
 static ngx_int_t FiretailResponseBodyFilterFinalise(ngx_http_request_t *request, FiretailFilterContext *ctx,
@@ -66,30 +70,34 @@ ngx_int_t FiretailResponseBodyFilter(ngx_http_request_t *request, ngx_chain_t *c
       updated_response_body_i = ngx_copy(updated_response_body_i, current_chain_link->buf->pos, buffer_length);
     }
 
-    // Update the ctx with the new updated body
+    // Update the ctx with the new updated body, freeing the body read so far now it's been copied over
+    ngx_pfree(request->pool, ctx->response_body);
     ctx->response_body = updated_response_body;
-
-    ngx_pfree(request->pool, updated_response_body);
   }
 
+  // Capture the exchange as it's about to be validated, so it can be replayed against the validator later
+  FiretailCaptureExchange(request, ctx);
+
   struct ValidateResponseBody_return validation_result;
   if (ctx->bypass_response == 0) {
-    // Get the response header values
-    json_object *response_headers_root = json_object_new_object();
-    for (ngx_list_part_t *response_header_list_part = &request->headers_out.headers.part;
-         response_header_list_part != NULL; response_header_list_part = response_header_list_part->next) {
-      for (ngx_table_elt_t *response_header = response_header_list_part->elts;
-           (ngx_uint_t)response_header <
-           (ngx_uint_t)response_header_list_part->elts + response_header_list_part->nelts * sizeof(ngx_table_elt_t);
-           response_header++) {
-        json_object_object_add(response_headers_root, (char *)response_header->key.data,
-                               json_object_new_string((char *)response_header->value.data));
+    FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
+
+    // If the native validators cover the response and find it valid then the Go validator needn't validate it. It's
+    // still called if there's an API token, but only to log the exchange.
+    uint64_t validation_start_usec = FiretailMonotonicUsec();
+    ngx_int_t response_validated_natively = FiretailValidateResponseNatively(request, ctx) == NGX_OK;
+    if (response_validated_natively && main_config->FiretailApiToken.len == 0) {
+      // The body is sent from a copy, as it would be from the one the Go validator returns
+      u_char *response = ngx_alloc(ctx->response_body_size + 1, request->connection->log);
+      if (response != NULL) {
+        *ngx_cpymem(response, ctx->response_body, ctx->response_body_size) = '\0';
+        ctx->response_validation_usec = FiretailMonotonicUsec() - validation_start_usec;
+        ctx->response_validated = 1;
+        ctx->verdict = FIRETAIL_VERDICT_PASSED;
+        return FiretailResponseBodyFilterFinalise(request, ctx, FiretailResponseBodyFilterBuffer(request, response),
+                                                  NULL);
       }
     }
-    // Don't forget to add the Content-Type; NGINX doesn't keep it in `headers_out.headers` - it gets special treatment.
-    json_object_object_add(response_headers_root, (char *)"Content-Type",
-                           json_object_new_string((char *)request->headers_out.content_type.data));
-    char *response_headers_json_string = (char *)json_object_to_json_string(response_headers_root);
 
     // Load the validator module & get the ValidateResponseBody function
     void *validator_module = dlopen("/etc/nginx/modules/firetail-validator.so", RTLD_LAZY);
@@ -105,15 +113,29 @@ ngx_int_t FiretailResponseBodyFilter(ngx_http_request_t *request, ngx_chain_t *c
     }
     ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validating response body...");
 
-    FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
+    // The request's body & headers are only passed if the validator doesn't have a handle to them already, from when
+    // it validated the request, which is the case if the native validators validated the request instead. They're
+    // passed with the capture policy applied. The response body and headers are passed in full as they may still
+    // need validating, along with how much of the body to log and the headers with the capture policy applied.
+    ngx_uint_t pass_request = ctx->request_handle == 0;
     validation_result = response_body_validator(
         (char *)main_config->FiretailUrl.data, main_config->FiretailUrl.len, (char *)main_config->FiretailApiToken.data,
         main_config->FiretailApiToken.len, (char *)main_config->FiretailAllowUndefinedRoutes.data,
-        (int)main_config->FiretailAllowUndefinedRoutes.len, (char *)ctx->request_body, (int)ctx->request_body_size,
-        (char *)ctx->request_headers_json, (int)ctx->request_headers_json_size, ctx->response_body,
-        ctx->response_body_size, response_headers_json_string, strlen(response_headers_json_string),
-        request->unparsed_uri.data, request->unparsed_uri.len, ctx->status_code, request->method_name.data,
-        request->method_name.len);
+        (int)main_config->FiretailAllowUndefinedRoutes.len, ctx->request_handle,
+        pass_request ? ctx->request_body : NULL,
+        pass_request ? FiretailLoggedBodySize(main_config, ctx->request_body_size) : 0,
+        pass_request ? (char *)ctx->logged_request_headers_json : NULL,
+        pass_request ? (int)ctx->logged_request_headers_json_size : 0, ctx->response_body, ctx->response_body_size,
+        FiretailLoggedBodySize(main_config, ctx->response_body_size), (char *)ctx->response_headers_json,
+        (int)ctx->response_headers_json_size,
+        ctx->logged_response_headers_json != ctx->response_headers_json ? (char *)ctx->logged_response_headers_json
+                                                                          : NULL,
+        (int)ctx->logged_response_headers_json_size, request->unparsed_uri.data,
+        request->unparsed_uri.len, ctx->status_code, request->method_name.data, request->method_name.len,
+        (int)response_validated_natively);
+    ctx->response_validation_usec = FiretailMonotonicUsec() - validation_start_usec;
+    ctx->response_validated = 1;
+    ctx->verdict = validation_result.r0 > 0 ? FIRETAIL_VERDICT_RESPONSE_FAILED : FIRETAIL_VERDICT_PASSED;
     ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validation response result: %d", validation_result.r0);
     ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Validating response body: %s", validation_result.r1);
 
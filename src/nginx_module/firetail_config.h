@@ -1,3 +1,6 @@
+#ifndef FIRETAIL_CONFIG_INCLUDED
+#define FIRETAIL_CONFIG_INCLUDED
+
 #include <ngx_core.h>
 
 typedef struct {
@@ -5,4 +8,13 @@ typedef struct {
   ngx_str_t FiretailUrl;
   ngx_str_t FiretailAllowUndefinedRoutes;
   ngx_int_t FiretailEnabled;
+  ngx_array_t *FiretailLogHeaders;     // Header names to log (ngx_str_t); NULL means log every header
+  ngx_array_t *FiretailRedactHeaders;  // Header names whose values are redacted in logs (ngx_str_t)
+  size_t FiretailLogBodyMax;           // Max bytes of the request body to log; NGX_CONF_UNSET_SIZE means no limit
+  ngx_str_t FiretailCapturePath;       // The ring file exchanges are captured to; empty means capture is disabled
+  size_t FiretailCaptureSize;          // The size of the ring file's ring, excluding its header
+  // The ring file's mapping, once opened
+  struct FiretailCaptureRing *FiretailCaptureRing;
 } FiretailConfig;
+
+#endif
@@ -2,6 +2,7 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 #include "access_phase_handler.h"
+#include "capture.h"
 #include "filter_headers.h"
 #include "filter_response_body.h"
 #include "firetail_config.h"
@@ -39,14 +40,26 @@ void *CreateFiretailConfig(ngx_conf_t *configuration_object) {
 
   ngx_str_t firetail_api_token = ngx_string("");
   ngx_str_t firetail_url = ngx_string("");
+  ngx_str_t firetail_capture_path = ngx_string("");
   firetail_config->FiretailApiToken = firetail_api_token;
   firetail_config->FiretailUrl = firetail_url;
   firetail_config->FiretailEnabled = 0;
+  firetail_config->FiretailLogHeaders = NULL;
+  firetail_config->FiretailRedactHeaders = NULL;
+  firetail_config->FiretailLogBodyMax = NGX_CONF_UNSET_SIZE;
+  firetail_config->FiretailCapturePath = firetail_capture_path;
+  firetail_config->FiretailCaptureSize = 0;
+  firetail_config->FiretailCaptureRing = NULL;
 
   return firetail_config;
 }
 
-char *InitFiretailMainConfig(ngx_conf_t *configuration_object, void *http_main_config) { return NGX_CONF_OK; }
+char *InitFiretailMainConfig(ngx_conf_t *configuration_object, void *http_main_config) {
+  if (FiretailCaptureOpen(configuration_object, http_main_config) != NGX_OK) {
+    return NGX_CONF_ERROR;
+  }
+  return NGX_CONF_OK;
+}
 
 char *MergeFiretailLocationConfig(ngx_conf_t *cf, void *parent, void *child) {
   ngx_conf_merge_value(((FiretailConfig *)child)->FiretailEnabled, ((FiretailConfig *)parent)->FiretailEnabled, 0);
@@ -1,5 +1,6 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
+#include "firetail_variables.h"
 
 ngx_int_t FiretailInit(ngx_conf_t *cf);
 void *CreateFiretailConfig(ngx_conf_t *configuration_object);
@@ -7,7 +8,7 @@ char *InitFiretailMainConfig(ngx_conf_t *configuration_object, void *http_main_c
 char *MergeFiretailLocationConfig(ngx_conf_t *cf, void *parent, void *child);
 
 ngx_http_module_t kFiretailModuleContext = {
-    NULL,                        // preconfiguration
+    FiretailAddVariables,        // preconfiguration
     FiretailInit,                // postconfiguration
     CreateFiretailConfig,        // create main configuration
     InitFiretailMainConfig,      // init main configuration
@@ -1,4 +1,6 @@
 #include <ngx_http.h>
+#include "capture.h"
+#include "firetail_config.h"
 
 char *FiretailApiTokenDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
                                         void *http_main_config) {
@@ -52,3 +54,86 @@ char *FiretailEnableDirectiveCallback(ngx_conf_t *configuration_object, ngx_comm
 
   return NGX_CONF_OK;
 }
+
+char *FiretailHeaderListDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
+                                          void *http_main_config) {
+  // Find the header list field given the config pointer & offset in cmd
+  char *firetail_config = http_main_config;
+  ngx_array_t **header_list_field = (ngx_array_t **)(firetail_config + command_definition->offset);
+
+  // The directive may be repeated, in which case its header names are appended to the same list
+  if (*header_list_field == NULL) {
+    *header_list_field =
+        ngx_array_create(configuration_object->pool, configuration_object->args->nelts - 1, sizeof(ngx_str_t));
+    if (*header_list_field == NULL) {
+      return NGX_CONF_ERROR;
+    }
+  }
+
+  // Every arg after the directive's name is a header name
+  ngx_str_t *value = configuration_object->args->elts;
+  for (ngx_uint_t i = 1; i < configuration_object->args->nelts; i++) {
+    ngx_str_t *header_name = ngx_array_push(*header_list_field);
+    if (header_name == NULL) {
+      return NGX_CONF_ERROR;
+    }
+    *header_name = value[i];
+  }
+
+  return NGX_CONF_OK;
+}
+
+char *FiretailLogBodyMaxDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
+                                          void *http_main_config) {
+  // Find the firetail_log_body_max_field given the config pointer & offset in cmd
+  char *firetail_config = http_main_config;
+  size_t *firetail_log_body_max_field = (size_t *)(firetail_config + command_definition->offset);
+
+  // Parse the size from the configuration object, accepting suffixes such as k and m
+  ngx_str_t *value = configuration_object->args->elts;
+  ssize_t log_body_max = ngx_parse_size(&value[1]);
+  if (log_body_max == NGX_ERROR) {
+    ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, 0, "invalid value \"%V\" in \"%V\" directive", &value[1],
+                       &command_definition->name);
+    return NGX_CONF_ERROR;
+  }
+  *firetail_log_body_max_field = (size_t)log_body_max;
+
+  return NGX_CONF_OK;
+}
+
+char *FiretailCaptureDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
+                                       void *http_main_config) {
+  FiretailConfig *firetail_config = http_main_config;
+  if (firetail_config->FiretailCapturePath.len > 0) {
+    return "is duplicate";
+  }
+
+  // The first arg is the path of the ring file
+  ngx_str_t *value = configuration_object->args->elts;
+  firetail_config->FiretailCapturePath = value[1];
+  firetail_config->FiretailCaptureSize = FIRETAIL_CAPTURE_DEFAULT_SIZE;
+
+  // The optional second arg is the size of the ring, given as size=...
+  if (configuration_object->args->nelts == 3) {
+    if (value[2].len <= 5 || ngx_strncmp(value[2].data, "size=", 5) != 0) {
+      ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, 0, "invalid parameter \"%V\" in \"%V\" directive",
+                         &value[2], &command_definition->name);
+      return NGX_CONF_ERROR;
+    }
+
+    ngx_str_t capture_size_value = {value[2].len - 5, value[2].data + 5};
+    ssize_t capture_size = ngx_parse_size(&capture_size_value);
+    if (capture_size == NGX_ERROR || capture_size < FIRETAIL_CAPTURE_MIN_SIZE) {
+      ngx_conf_log_error(NGX_LOG_EMERG, configuration_object, 0,
+                         "invalid size \"%V\" in \"%V\" directive, it must be at least 64k", &capture_size_value,
+                         &command_definition->name);
+      return NGX_CONF_ERROR;
+    }
+
+    // Records are aligned to 8 bytes, so the ring is too
+    firetail_config->FiretailCaptureSize = FIRETAIL_CAPTURE_ALIGN((size_t)capture_size);
+  }
+
+  return NGX_CONF_OK;
+}
@@ -10,8 +10,14 @@ char *FiretailAllowUndefinedRoutesDirectiveCallback(ngx_conf_t *configuration_ob
                                                     void *http_main_config);
 char *FiretailEnableDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
                                       void *http_main_config);
+char *FiretailHeaderListDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
+                                          void *http_main_config);
+char *FiretailLogBodyMaxDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
+                                          void *http_main_config);
+char *FiretailCaptureDirectiveCallback(ngx_conf_t *configuration_object, ngx_command_t *command_definition,
+                                       void *http_main_config);
 
-ngx_command_t kFiretailCommands[5] = {
+ngx_command_t kFiretailCommands[9] = {
     {// Name of the directive
      ngx_string("firetail_api_token"),
      // Valid in the main config and takes one arg
@@ -41,4 +47,35 @@ ngx_command_t kFiretailCommands[5] = {
      // A callback function to be called when the directive is found in the
      // configuration
      FiretailEnableDirectiveCallback, NGX_HTTP_LOC_CONF_OFFSET, offsetof(FiretailConfig, FiretailEnabled), NULL},
+    {// Name of the directive
+     ngx_string("firetail_log_headers"),
+     // Valid in the main config and takes one or more args
+     NGX_HTTP_MAIN_CONF | NGX_CONF_1MORE,
+     // A callback function to be called when the directive is found in the
+     // configuration
+     FiretailHeaderListDirectiveCallback, NGX_HTTP_MAIN_CONF_OFFSET, offsetof(FiretailConfig, FiretailLogHeaders),
+     NULL},
+    {// Name of the directive
+     ngx_string("firetail_redact_headers"),
+     // Valid in the main config and takes one or more args
+     NGX_HTTP_MAIN_CONF | NGX_CONF_1MORE,
+     // A callback function to be called when the directive is found in the
+     // configuration
+     FiretailHeaderListDirectiveCallback, NGX_HTTP_MAIN_CONF_OFFSET, offsetof(FiretailConfig, FiretailRedactHeaders),
+     NULL},
+    {// Name of the directive
+     ngx_string("firetail_log_body_max"),
+     // Valid in the main config and takes one arg
+     NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
+     // A callback function to be called when the directive is found in the
+     // configuration
+     FiretailLogBodyMaxDirectiveCallback, NGX_HTTP_MAIN_CONF_OFFSET, offsetof(FiretailConfig, FiretailLogBodyMax),
+     NULL},
+    {// Name of the directive
+     ngx_string("firetail_capture"),
+     // Valid in the main config and takes a path and an optional size=
+     NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE12,
+     // A callback function to be called when the directive is found in the
+     // configuration
+     FiretailCaptureDirectiveCallback, NGX_HTTP_MAIN_CONF_OFFSET, 0, NULL},
     ngx_null_command};
@@ -0,0 +1,124 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include "filter_context.h"
+#include "firetail_module.h"
+#include "firetail_variables.h"
+
+static ngx_int_t FiretailRequestValidationTimeVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                                       uintptr_t data);
+static ngx_int_t FiretailResponseValidationTimeVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                                        uintptr_t data);
+static ngx_int_t FiretailVerdictVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                         uintptr_t data);
+static ngx_int_t FiretailOperationIdVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                             uintptr_t data);
+static ngx_int_t FiretailBufferedBytesVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                               uintptr_t data);
+
+static ngx_http_variable_t kFiretailVariables[] = {
+    {ngx_string("firetail_request_validation_time"), NULL, FiretailRequestValidationTimeVariable, 0,
+     NGX_HTTP_VAR_NOCACHEABLE, 0},
+    {ngx_string("firetail_response_validation_time"), NULL, FiretailResponseValidationTimeVariable, 0,
+     NGX_HTTP_VAR_NOCACHEABLE, 0},
+    {ngx_string("firetail_verdict"), NULL, FiretailVerdictVariable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0},
+    {ngx_string("firetail_operation_id"), NULL, FiretailOperationIdVariable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0},
+    {ngx_string("firetail_buffered_bytes"), NULL, FiretailBufferedBytesVariable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0},
+    ngx_http_null_variable};
+
+static ngx_str_t kFiretailVerdicts[] = {
+    ngx_null_string,
+    ngx_string("passed"),
+    ngx_string("request_failed"),
+    ngx_string("response_failed"),
+};
+
+ngx_int_t FiretailAddVariables(ngx_conf_t *cf) {
+  for (ngx_http_variable_t *variable_definition = kFiretailVariables; variable_definition->name.len;
+       variable_definition++) {
+    ngx_http_variable_t *variable = ngx_http_add_variable(cf, &variable_definition->name, variable_definition->flags);
+    if (variable == NULL) {
+      return NGX_ERROR;
+    }
+    variable->get_handler = variable_definition->get_handler;
+    variable->data = variable_definition->data;
+  }
+  return NGX_OK;
+}
+
+// Sets the variable's value to the given string
+static ngx_int_t FiretailSetVariableValue(ngx_http_variable_value_t *value, u_char *data, size_t len) {
+  value->len = len;
+  value->valid = 1;
+  value->no_cacheable = 1;
+  value->not_found = 0;
+  value->data = data;
+  return NGX_OK;
+}
+
+// Formats a duration in microseconds as seconds, to match the units of nginx's own $request_time
+static ngx_int_t FiretailValidationTimeVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                                uint64_t duration_usec) {
+  u_char *data = ngx_pnalloc(request->pool, NGX_INT64_LEN + sizeof(".000000") - 1);
+  if (data == NULL) {
+    return NGX_ERROR;
+  }
+  u_char *last = ngx_sprintf(data, "%uL.%06uL", duration_usec / 1000000, duration_usec % 1000000);
+  return FiretailSetVariableValue(value, data, last - data);
+}
+
+static ngx_int_t FiretailRequestValidationTimeVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                                       uintptr_t data) {
+  FiretailFilterContext *ctx = ngx_http_get_module_ctx(request, ngx_firetail_module);
+  if (ctx == NULL || !ctx->request_validated) {
+    value->not_found = 1;
+    return NGX_OK;
+  }
+  return FiretailValidationTimeVariable(request, value, ctx->request_validation_usec);
+}
+
+static ngx_int_t FiretailResponseValidationTimeVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                                        uintptr_t data) {
+  FiretailFilterContext *ctx = ngx_http_get_module_ctx(request, ngx_firetail_module);
+  if (ctx == NULL || !ctx->response_validated) {
+    value->not_found = 1;
+    return NGX_OK;
+  }
+  return FiretailValidationTimeVariable(request, value, ctx->response_validation_usec);
+}
+
+static ngx_int_t FiretailVerdictVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                         uintptr_t data) {
+  FiretailFilterContext *ctx = ngx_http_get_module_ctx(request, ngx_firetail_module);
+  if (ctx == NULL || ctx->verdict == FIRETAIL_VERDICT_NONE) {
+    value->not_found = 1;
+    return NGX_OK;
+  }
+  return FiretailSetVariableValue(value, kFiretailVerdicts[ctx->verdict].data, kFiretailVerdicts[ctx->verdict].len);
+}
+
+static ngx_int_t FiretailOperationIdVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                             uintptr_t data) {
+  FiretailFilterContext *ctx = ngx_http_get_module_ctx(request, ngx_firetail_module);
+  if (ctx == NULL || ctx->operation_id.len == 0) {
+    value->not_found = 1;
+    return NGX_OK;
+  }
+  return FiretailSetVariableValue(value, ctx->operation_id.data, ctx->operation_id.len);
+}
+
+static ngx_int_t FiretailBufferedBytesVariable(ngx_http_request_t *request, ngx_http_variable_value_t *value,
+                                               uintptr_t data) {
+  FiretailFilterContext *ctx = ngx_http_get_module_ctx(request, ngx_firetail_module);
+  if (ctx == NULL) {
+    value->not_found = 1;
+    return NGX_OK;
+  }
+
+  u_char *buffered_bytes = ngx_pnalloc(request->pool, NGX_INT64_LEN);
+  if (buffered_bytes == NULL) {
+    return NGX_ERROR;
+  }
+  u_char *last = ngx_sprintf(buffered_bytes, "%l", ctx->request_body_size + ctx->response_body_size);
+  return FiretailSetVariableValue(value, buffered_bytes, last - buffered_bytes);
+}
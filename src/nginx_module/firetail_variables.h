@@ -0,0 +1,11 @@
+#ifndef FIRETAIL_VARIABLES_INCLUDED
+#define FIRETAIL_VARIABLES_INCLUDED
+
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+// Registers the $firetail_* variables, which expose validation timings & outcomes from FiretailFilterContext so they
+// can be used in log_format
+ngx_int_t FiretailAddVariables(ngx_conf_t *cf);
+
+#endif
@@ -0,0 +1,152 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include "native_validation.h"
+#include "native_validator.h"
+
+// Where the Go validator publishes the MD5 of the appspec it's using. This must match the struct declared in
+// src/validator/appspec_version.go.
+typedef struct {
+  uint64_t sequence;
+  char md5[32];
+} FiretailAppspecVersion;
+
+typedef void (*ReportAppspecVersion)(FiretailAppspecVersion *);
+
+// Each worker process loads the native validators the first time they're needed, and keeps them loaded
+typedef struct {
+  ngx_uint_t loaded;
+  const char *appspec_md5;
+  FiretailNativeValidateRequestFunction validate_request;
+  FiretailNativeValidateResponseFunction validate_response;
+  // The native validators are only used while the Go validator is using the appspec they were generated from. The Go
+  // validator writes the MD5 of each version of the appspec it makes current to go_appspec_version, so they're never
+  // used with a version of the appspec the Go validator hasn't loaded, however quickly the appspec changes.
+  FiretailAppspecVersion go_appspec_version;
+  uint64_t warned_sequence;
+} FiretailNativeValidators;
+
+static FiretailNativeValidators native_validators;
+
+static FiretailNativeValidators *FiretailGetNativeValidators(ngx_log_t *log);
+static ngx_uint_t FiretailNativeAppspecMatches(ngx_log_t *log);
+
+ngx_int_t FiretailValidateRequestNatively(ngx_http_request_t *request, FiretailFilterContext *ctx) {
+  FiretailNativeValidators *validators = FiretailGetNativeValidators(request->connection->log);
+  if (validators == NULL) {
+    return NGX_DECLINED;
+  }
+
+  ngx_str_t content_type = ngx_null_string;
+  if (request->headers_in.content_type != NULL) {
+    content_type = request->headers_in.content_type->value;
+  }
+
+  const char *operation_id = NULL;
+  int result = validators->validate_request(
+      (char *)request->method_name.data, request->method_name.len, (char *)request->unparsed_uri.data,
+      request->unparsed_uri.len, (char *)content_type.data, content_type.len, (char *)ctx->request_body,
+      ctx->request_body_size, &operation_id);
+  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Native request validation result: %d", result);
+  if (result != FIRETAIL_NATIVE_VALID) {
+    return NGX_DECLINED;
+  }
+
+  // The operation ID belongs to the native validators, which are never unloaded
+  if (operation_id != NULL) {
+    ctx->operation_id.data = (u_char *)operation_id;
+    ctx->operation_id.len = ngx_strlen(operation_id);
+  }
+  return NGX_OK;
+}
+
+ngx_int_t FiretailValidateResponseNatively(ngx_http_request_t *request, FiretailFilterContext *ctx) {
+  FiretailNativeValidators *validators = FiretailGetNativeValidators(request->connection->log);
+  if (validators == NULL) {
+    return NGX_DECLINED;
+  }
+
+  int result = validators->validate_response(
+      (char *)request->method_name.data, request->method_name.len, (char *)request->unparsed_uri.data,
+      request->unparsed_uri.len, ctx->status_code, (char *)request->headers_out.content_type.data,
+      request->headers_out.content_type.len, (char *)ctx->response_body, ctx->response_body_size);
+  ngx_log_debug(NGX_LOG_DEBUG, request->connection->log, 0, "Native response validation result: %d", result);
+  return result == FIRETAIL_NATIVE_VALID ? NGX_OK : NGX_DECLINED;
+}
+
+// Returns the native validators, or NULL if they aren't installed or weren't generated from the current appspec
+static FiretailNativeValidators *FiretailGetNativeValidators(ngx_log_t *log) {
+  if (!native_validators.loaded) {
+    native_validators.loaded = 1;
+
+    void *native_module = dlopen(FIRETAIL_NATIVE_VALIDATORS_PATH, RTLD_NOW | RTLD_LOCAL);
+    if (native_module == NULL) {
+      ngx_log_debug(NGX_LOG_DEBUG, log, 0, "Native validators not loaded: %s", dlerror());
+      return NULL;
+    }
+    native_validators.appspec_md5 = dlsym(native_module, FIRETAIL_NATIVE_APPSPEC_MD5_SYMBOL);
+    native_validators.validate_request = dlsym(native_module, FIRETAIL_NATIVE_VALIDATE_REQUEST_SYMBOL);
+    native_validators.validate_response = dlsym(native_module, FIRETAIL_NATIVE_VALIDATE_RESPONSE_SYMBOL);
+    if (native_validators.appspec_md5 == NULL || native_validators.validate_request == NULL ||
+        native_validators.validate_response == NULL) {
+      ngx_log_error(NGX_LOG_ERR, log, 0,
+                    "Failed to load native validators from " FIRETAIL_NATIVE_VALIDATORS_PATH ": %s", dlerror());
+      native_validators.appspec_md5 = NULL;
+      dlclose(native_module);
+      return NULL;
+    }
+
+    // Go shared libraries can't be unloaded, so the Go validator keeps writing to go_appspec_version after this
+    void *validator_module = dlopen("/etc/nginx/modules/firetail-validator.so", RTLD_LAZY);
+    ReportAppspecVersion appspec_version_reporter =
+        validator_module != NULL ? (ReportAppspecVersion)dlsym(validator_module, "ReportAppspecVersion") : NULL;
+    if (appspec_version_reporter == NULL) {
+      ngx_log_error(NGX_LOG_ERR, log, 0, "Failed to find which appspec the validator is using, so "
+                    FIRETAIL_NATIVE_VALIDATORS_PATH " won't be used: %s", dlerror());
+      native_validators.appspec_md5 = NULL;
+      if (validator_module != NULL) {
+        dlclose(validator_module);
+      }
+      dlclose(native_module);
+      return NULL;
+    }
+    appspec_version_reporter(&native_validators.go_appspec_version);
+    dlclose(validator_module);
+  }
+  if (native_validators.appspec_md5 == NULL) {
+    return NULL;
+  }
+
+  return FiretailNativeAppspecMatches(log) ? &native_validators : NULL;
+}
+
+// Returns 1 if the appspec the Go validator is using has the MD5 the native validators were generated from. Until the
+// Go validator has loaded the appspec, which it does the first time it validates an exchange, it's assumed not to.
+static ngx_uint_t FiretailNativeAppspecMatches(ngx_log_t *log) {
+  volatile FiretailAppspecVersion *go_appspec_version = &native_validators.go_appspec_version;
+
+  uint64_t sequence = go_appspec_version->sequence;
+  ngx_memory_barrier();
+  if (sequence == 0 || sequence % 2 != 0) {
+    return 0;
+  }
+  u_char appspec_md5[32];
+  for (size_t i = 0; i < sizeof(appspec_md5); i++) {
+    appspec_md5[i] = go_appspec_version->md5[i];
+  }
+  ngx_memory_barrier();
+  if (go_appspec_version->sequence != sequence) {
+    return 0;
+  }
+
+  if (ngx_strncmp(appspec_md5, native_validators.appspec_md5, sizeof(appspec_md5)) != 0) {
+    if (native_validators.warned_sequence != sequence) {
+      native_validators.warned_sequence = sequence;
+      ngx_log_error(NGX_LOG_WARN, log, 0,
+                    FIRETAIL_NATIVE_VALIDATORS_PATH " was generated from a different appspec to the one the validator"
+                                                    " is using, so it won't be used until it's regenerated");
+    }
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,19 @@
+#ifndef FIRETAIL_NATIVE_VALIDATION_INCLUDED
+#define FIRETAIL_NATIVE_VALIDATION_INCLUDED
+
+#include <ngx_core.h>
+#include <ngx_http.h>
+#include "filter_context.h"
+
+// Where the native validators generated from the appspec are installed. If they're not, the Go validator is used.
+#define FIRETAIL_NATIVE_VALIDATORS_PATH "/etc/nginx/modules/firetail-native-validators.so"
+
+// Returns NGX_OK if the native validators cover the request's operation and found the request valid, setting the
+// operation ID in ctx. Otherwise returns NGX_DECLINED, and the Go validator should validate the request.
+ngx_int_t FiretailValidateRequestNatively(ngx_http_request_t *request, FiretailFilterContext *ctx);
+
+// Returns NGX_OK if the native validators cover the response's operation and status code and found the response
+// valid. Otherwise returns NGX_DECLINED, and the Go validator should validate the response.
+ngx_int_t FiretailValidateResponseNatively(ngx_http_request_t *request, FiretailFilterContext *ctx);
+
+#endif
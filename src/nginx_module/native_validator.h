@@ -0,0 +1,36 @@
+#ifndef FIRETAIL_NATIVE_VALIDATOR_INCLUDED
+#define FIRETAIL_NATIVE_VALIDATOR_INCLUDED
+
+// The entry points of firetail-native-validators.so, which holds C validators generated from an appspec by
+// src/validator/codegen. This header is shared with the native validators and the replay tool so it must only depend
+// upon the C standard library.
+//
+// Native validators only speed up the common case. They answer FIRETAIL_NATIVE_VALID only when they are certain the
+// Go validator would accept the exchange; anything they reject, or don't cover, should be passed on to the Go
+// validator which has the final say and produces the error response.
+
+#include <stddef.h>
+
+#define FIRETAIL_NATIVE_VALID 0
+#define FIRETAIL_NATIVE_INVALID 1
+#define FIRETAIL_NATIVE_NOT_COVERED 2
+
+// The MD5 of the appspec the native validators were generated from, as 32 lowercase hex digits
+#define FIRETAIL_NATIVE_APPSPEC_MD5_SYMBOL "FiretailNativeAppspecMd5"
+
+// Validates a request's body. If the request matched an operation in the appspec, operation_id is set to its
+// operationId, or its method and path if it has none.
+#define FIRETAIL_NATIVE_VALIDATE_REQUEST_SYMBOL "FiretailNativeValidateRequest"
+typedef int (*FiretailNativeValidateRequestFunction)(const char *method, size_t method_length, const char *uri,
+                                                     size_t uri_length, const char *content_type,
+                                                     size_t content_type_length, const char *body, size_t body_length,
+                                                     const char **operation_id);
+
+// Validates a response's body
+#define FIRETAIL_NATIVE_VALIDATE_RESPONSE_SYMBOL "FiretailNativeValidateResponse"
+typedef int (*FiretailNativeValidateResponseFunction)(const char *method, size_t method_length, const char *uri,
+                                                      size_t uri_length, int status_code, const char *content_type,
+                                                      size_t content_type_length, const char *body,
+                                                      size_t body_length);
+
+#endif
@@ -0,0 +1,201 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_http.h>
+#include "capture_policy.h"
+#include "firetail_config.h"
+#include "firetail_module.h"
+#include "validation_batch.h"
+
+// A request waiting to be validated, or to be resumed once its batch has been validated
+typedef struct {
+  ngx_queue_t queue;
+  ngx_uint_t queued;
+  ngx_uint_t validated;
+  ngx_http_request_t *request;
+  FiretailRequestValidatedHandler handler;
+  FiretailRequestValidation validation;
+} FiretailQueuedValidation;
+
+// Each worker process has its own queue, which is validated by a posted event once the event loop has handled the
+// events that queued the requests
+typedef struct {
+  ngx_uint_t initialised;
+  ngx_queue_t queue;
+  ngx_event_t event;
+  ReleaseRequest request_releaser;
+} FiretailValidationQueue;
+
+static FiretailValidationQueue validation_queue;
+
+static void FiretailValidateQueuedRequests(ngx_event_t *event);
+static void FiretailDequeueRequestValidation(void *data);
+
+ngx_int_t FiretailQueueRequestValidation(ngx_http_request_t *request, FiretailFilterContext *ctx,
+                                         FiretailRequestValidatedHandler handler) {
+  FiretailConfig *main_config = ngx_http_get_module_main_conf(request, ngx_firetail_module);
+
+  if (!validation_queue.initialised) {
+    ngx_queue_init(&validation_queue.queue);
+    validation_queue.event.handler = FiretailValidateQueuedRequests;
+    validation_queue.event.log = ngx_cycle->log;
+    validation_queue.initialised = 1;
+  }
+
+  FiretailQueuedValidation *queued_validation = ngx_pcalloc(request->pool, sizeof(FiretailQueuedValidation));
+  ngx_pool_cleanup_t *cln = ngx_pool_cleanup_add(request->pool, 0);
+  if (queued_validation == NULL || cln == NULL) {
+    return NGX_ERROR;
+  }
+
+  queued_validation->request = request;
+  queued_validation->handler = handler;
+
+  FiretailRequestValidation *validation = &queued_validation->validation;
+  validation->body = ctx->request_body;
+  validation->body_length = ctx->request_body_size;
+  validation->path = request->unparsed_uri.data;
+  validation->path_length = request->unparsed_uri.len;
+  validation->method = request->method_name.data;
+  validation->method_length = request->method_name.len;
+  validation->headers = ctx->request_headers_json;
+  validation->headers_length = ctx->request_headers_json_size;
+  validation->logged_headers =
+      ctx->logged_request_headers_json != ctx->request_headers_json ? ctx->logged_request_headers_json : NULL;
+  validation->logged_headers_length = ctx->logged_request_headers_json_size;
+  validation->logged_body_length = FiretailLoggedBodySize(main_config, ctx->request_body_size);
+
+  // If the request is terminated before it's resumed, e.g. because its connection was closed, then it's taken back out
+  // of the queue or batch it's in
+  cln->handler = FiretailDequeueRequestValidation;
+  cln->data = queued_validation;
+
+  ngx_queue_insert_tail(&validation_queue.queue, &queued_validation->queue);
+  queued_validation->queued = 1;
+
+  // The queue holds a reference to the request until it's been resumed, so it can't be freed by being finalised early
+  request->main->count++;
+
+  ngx_post_event(&validation_queue.event, &ngx_posted_events);
+
+  return NGX_AGAIN;
+}
+
+static void FiretailValidateQueuedRequests(ngx_event_t *event) {
+  if (ngx_queue_empty(&validation_queue.queue)) {
+    return;
+  }
+
+  // Take the queued requests as this batch, so any queued while it's resumed go into the next one
+  ngx_queue_t batch;
+  ngx_queue_init(&batch);
+  ngx_queue_add(&batch, &validation_queue.queue);
+  ngx_queue_init(&validation_queue.queue);
+
+  ngx_uint_t batch_length = 0;
+  for (ngx_queue_t *q = ngx_queue_head(&batch); q != ngx_queue_sentinel(&batch); q = ngx_queue_next(q)) {
+    batch_length++;
+  }
+
+  FiretailQueuedValidation *first = ngx_queue_data(ngx_queue_head(&batch), FiretailQueuedValidation, queue);
+  FiretailConfig *main_config = ngx_http_get_module_main_conf(first->request, ngx_firetail_module);
+
+  // The validator takes the batch as one contiguous array. If the batch can't be validated then its requests are
+  // resumed without a validation, and rejected rather than passed on unvalidated.
+  FiretailRequestValidation *validations = ngx_alloc(batch_length * sizeof(FiretailRequestValidation), event->log);
+  void *validator_module = NULL;
+  if (validations != NULL) {
+    validator_module = dlopen("/etc/nginx/modules/firetail-validator.so", RTLD_LAZY);
+    if (validator_module == NULL) {
+      ngx_log_error(NGX_LOG_ERR, event->log, 0, "Failed to load the validator, so %ui requests will be rejected: %s",
+                    batch_length, dlerror());
+    }
+  } else {
+    ngx_log_error(NGX_LOG_ERR, event->log, 0, "Failed to allocate a batch of %ui requests, so they will be rejected",
+                  batch_length);
+  }
+
+  if (validator_module != NULL) {
+    ValidateRequestBodies request_bodies_validator =
+        (ValidateRequestBodies)dlsym(validator_module, "ValidateRequestBodies");
+    char *error;
+    if ((error = dlerror()) != NULL) {
+      ngx_log_debug(NGX_LOG_DEBUG, event->log, 0, "Failed to load ValidateRequestBodies: %s", error);
+      exit(1);
+    }
+    validation_queue.request_releaser = (ReleaseRequest)dlsym(validator_module, "ReleaseRequest");
+    if ((error = dlerror()) != NULL) {
+      ngx_log_debug(NGX_LOG_DEBUG, event->log, 0, "Failed to load ReleaseRequest: %s", error);
+      exit(1);
+    }
+    ngx_log_debug(NGX_LOG_DEBUG, event->log, 0, "Validating a batch of %ui request bodies...", batch_length);
+
+    ngx_uint_t i = 0;
+    for (ngx_queue_t *q = ngx_queue_head(&batch); q != ngx_queue_sentinel(&batch); q = ngx_queue_next(q)) {
+      validations[i++] = ngx_queue_data(q, FiretailQueuedValidation, queue)->validation;
+    }
+
+    // The batch is validated synchronously, so this worker's event loop is blocked until the slowest request in it has
+    // been validated. Every request in the batch waits for the whole batch, so that's the time each of them spends
+    // being validated.
+    uint64_t validation_start_usec = FiretailMonotonicUsec();
+    request_bodies_validator(main_config->FiretailAllowUndefinedRoutes.data,
+                             main_config->FiretailAllowUndefinedRoutes.len, validations, batch_length);
+    uint64_t validation_usec = FiretailMonotonicUsec() - validation_start_usec;
+
+    i = 0;
+    for (ngx_queue_t *q = ngx_queue_head(&batch); q != ngx_queue_sentinel(&batch); q = ngx_queue_next(q)) {
+      FiretailQueuedValidation *queued_validation = ngx_queue_data(q, FiretailQueuedValidation, queue);
+      queued_validation->validation = validations[i++];
+      queued_validation->validated = 1;
+
+      FiretailFilterContext *ctx = GetFiretailFilterContext(queued_validation->request);
+      if (ctx != NULL) {
+        ctx->request_validation_usec = validation_usec;
+      }
+    }
+
+    // Go shared libraries can't be unloaded, so the request releaser is still valid after this
+    dlclose(validator_module);
+  }
+  ngx_free(validations);
+
+  // Resuming one request can terminate others in the batch, e.g. by closing the HTTP/2 connection they share, in which
+  // case their pool cleanups take them out of the batch. Each request is resumed from the event loop rather than
+  // from its own connection's event handler, so any subrequests it posts have to be run here.
+  while (!ngx_queue_empty(&batch)) {
+    ngx_queue_t *head = ngx_queue_head(&batch);
+    FiretailQueuedValidation *queued_validation = ngx_queue_data(head, FiretailQueuedValidation, queue);
+    ngx_queue_remove(head);
+    queued_validation->queued = 0;
+
+    ngx_http_request_t *request = queued_validation->request;
+    ngx_connection_t *connection = request->connection;
+    queued_validation->handler(request, queued_validation->validated ? &queued_validation->validation : NULL,
+                               validation_queue.request_releaser);
+
+    // Then the queue's reference to the request is dropped, which frees it if the handler finalised it
+    ngx_http_finalize_request(request, NGX_DONE);
+    ngx_http_run_posted_requests(connection);
+  }
+}
+
+static void FiretailDequeueRequestValidation(void *data) {
+  FiretailQueuedValidation *queued_validation = data;
+  if (!queued_validation->queued) {
+    return;
+  }
+
+  ngx_queue_remove(&queued_validation->queue);
+  queued_validation->queued = 0;
+
+  // If it was terminated after being validated then nothing else will free what the validator gave back for it
+  if (queued_validation->validated) {
+    FiretailRequestValidation *validation = &queued_validation->validation;
+    ngx_free(validation->response);
+    ngx_free(validation->operation_id);
+    if (validation->request_handle != 0) {
+      validation_queue.request_releaser(validation->request_handle);
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef FIRETAIL_VALIDATION_BATCH_INCLUDED
+#define FIRETAIL_VALIDATION_BATCH_INCLUDED
+
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_http.h>
+#include "filter_context.h"
+
+// A request for the validator's ValidateRequestBodies entry point to validate, and the results it gives back, which
+// are the same as those of ValidateRequestBody. This must match the struct declared in src/validator/batch.go.
+typedef struct {
+  void *body;
+  int body_length;
+  void *path;
+  int path_length;
+  void *method;
+  int method_length;
+  void *headers;
+  int headers_length;
+  void *logged_headers;
+  int logged_headers_length;
+  int logged_body_length;
+  int result;
+  char *response;
+  char *operation_id;
+  uintptr_t request_handle;
+} FiretailRequestValidation;
+
+typedef void (*ValidateRequestBodies)(void *, int, FiretailRequestValidation *, int);
+typedef void (*ReleaseRequest)(uintptr_t);
+
+// Called for each request in a batch once the validator has validated it. validation is NULL if the batch couldn't be
+// validated, e.g. because the validator couldn't be loaded, in which case the request must be rejected. The handler
+// owns the strings in validation and the request handle. The queue holds a reference to the request until the handler
+// returns, so the handler may finalise it.
+typedef void (*FiretailRequestValidatedHandler)(ngx_http_request_t *request, FiretailRequestValidation *validation,
+                                                ReleaseRequest request_releaser);
+
+// Queues the request held in ctx to be validated along with every other request queued during this iteration of the
+// event loop, in a single call into the validator once the iteration's events have been handled. Returns NGX_AGAIN
+// once it's queued, after which handler is called to resume the request, or NGX_ERROR.
+ngx_int_t FiretailQueueRequestValidation(ngx_http_request_t *request, FiretailFilterContext *ctx,
+                                         FiretailRequestValidatedHandler handler);
+
+#endif
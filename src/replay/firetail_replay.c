@@ -0,0 +1,766 @@
+// Replays exchanges captured by the firetail_capture directive into the validator's entry points, as fast as they will
+// go, and reports how long each entry point took. Build it with:
+//
+//   cc -O2 -o firetail-replay src/replay/firetail_replay.c -ldl
+//
+// Then run it against a capture file and a build of the validator:
+//
+//   ./firetail-replay -v /etc/nginx/modules/firetail-validator.so -n 10 /var/log/nginx/firetail.capture
+//
+// The validator loads the OpenAPI specification from /etc/nginx/appspec.yml as it does when used by the module. No
+// logs are sent to the FireTail platform as the replay tool gives the validator no API token or URL.
+//
+// Given native validators generated from the same appspec with -d, it instead checks them against the validator.
+// Every request & response they find valid is passed to the validator, and any the validator finds invalid are
+// reported. -f adds that many random mutations of each body, so the native validators' edge cases are exercised:
+//
+//   ./firetail-replay -d /etc/nginx/modules/firetail-native-validators.so -f 100 /var/log/nginx/firetail.capture
+//
+// Given a comma separated list of batch sizes with -b, it also replays the requests through the validator's
+// ValidateRequestBodies entry point in batches of each size, as the module does with the requests it reads during one
+// iteration of its event loop, and reports how much time per request batching saves:
+//
+//   ./firetail-replay -b 1,8,64,256 /var/log/nginx/firetail.capture
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../nginx_module/capture_format.h"
+#include "../nginx_module/native_validator.h"
+
+struct ValidateRequestBody_return {
+  int r0;
+  char *r1;
+  char *r2;
+  uintptr_t r3;
+};
+typedef struct ValidateRequestBody_return (*ValidateRequestBody)(void *, int, void *, int, void *, int, void *, int,
+                                                                 void *, int, void *, int, int);
+
+struct ValidateResponseBody_return {
+  int r0;
+  char *r1;
+};
+typedef struct ValidateResponseBody_return (*ValidateResponseBody)(char *, int, char *, int, char *, int, uintptr_t,
+                                                                   void *, int, char *, int, void *, int, int, char *,
+                                                                   int, char *, int, void *, int, int, void *, int,
+                                                                   int);
+typedef void (*ReleaseRequest)(uintptr_t);
+
+// This must match the struct declared in src/validator/batch.go
+typedef struct {
+  void *body;
+  int body_length;
+  void *path;
+  int path_length;
+  void *method;
+  int method_length;
+  void *headers;
+  int headers_length;
+  void *logged_headers;
+  int logged_headers_length;
+  int logged_body_length;
+  int result;
+  char *response;
+  char *operation_id;
+  uintptr_t request_handle;
+} FiretailRequestValidation;
+typedef void (*ValidateRequestBodies)(void *, int, FiretailRequestValidation *, int);
+
+// Only this many batch sizes can be given with -b
+#define MAX_BATCH_SIZES 16
+
+// The requests gathered for the next call to ValidateRequestBodies, and how long the batches made so far took to
+// validate with it, and one request at a time with ValidateRequestBody
+typedef struct {
+  size_t size;
+  size_t length;
+  FiretailRequestValidation *validations;
+  size_t batches;
+  size_t requests;
+  size_t failures;
+  double batched_usec;
+  double unbatched_usec;
+} RequestBatch;
+
+// The durations of every call made to one of the validator's entry points, and how many of them failed validation
+typedef struct {
+  const char *name;
+  double *durations_usec;
+  size_t count;
+  size_t capacity;
+  size_t failures;
+} EntryPointTimings;
+
+static double MonotonicUsec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static void RecordTiming(EntryPointTimings *timings, double duration_usec, int failed) {
+  if (timings->count == timings->capacity) {
+    timings->capacity = timings->capacity ? timings->capacity * 2 : 1024;
+    timings->durations_usec = realloc(timings->durations_usec, timings->capacity * sizeof(double));
+    if (timings->durations_usec == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  timings->durations_usec[timings->count++] = duration_usec;
+  timings->failures += failed != 0;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double difference = *(const double *)a - *(const double *)b;
+  return (difference > 0) - (difference < 0);
+}
+
+static void PrintTimings(EntryPointTimings *timings) {
+  if (timings->count == 0) {
+    printf("%-20s no calls\n", timings->name);
+    return;
+  }
+
+  double total_usec = 0;
+  for (size_t i = 0; i < timings->count; i++) {
+    total_usec += timings->durations_usec[i];
+  }
+  qsort(timings->durations_usec, timings->count, sizeof(double), CompareDoubles);
+
+  printf("%-20s calls=%zu failures=%zu mean=%.1fus p50=%.1fus p99=%.1fus max=%.1fus calls/s=%.0f\n", timings->name,
+         timings->count, timings->failures, total_usec / timings->count,
+         timings->durations_usec[timings->count / 2], timings->durations_usec[timings->count * 99 / 100],
+         timings->durations_usec[timings->count - 1], timings->count / (total_usec / 1e6));
+}
+
+// Reads a copy of the capture file, so nginx can keep capturing while we replay it. Records before oldest_offset may
+// have been overwritten by nginx while the copy was being read, so they should be skipped.
+static FiretailCaptureFileHeader *ReadCaptureFile(const char *path, uint64_t *oldest_offset) {
+  int fd = open(path, O_RDONLY);
+  struct stat capture_stat;
+  if (fd == -1 || fstat(fd, &capture_stat) == -1) {
+    perror(path);
+    return NULL;
+  }
+  if ((size_t)capture_stat.st_size < sizeof(FiretailCaptureFileHeader)) {
+    fprintf(stderr, "%s is not a FireTail capture file\n", path);
+    return NULL;
+  }
+
+  FiretailCaptureFileHeader *header = malloc(capture_stat.st_size);
+  if (header == NULL) {
+    perror("malloc");
+    return NULL;
+  }
+  for (size_t copied = 0; copied < (size_t)capture_stat.st_size;) {
+    ssize_t read_length = pread(fd, (char *)header + copied, capture_stat.st_size - copied, copied);
+    if (read_length <= 0) {
+      if (read_length == -1 && errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Failed to read %s: %s\n", path, read_length == 0 ? "file was truncated" : strerror(errno));
+      return NULL;
+    }
+    copied += read_length;
+  }
+
+  if (memcmp(header->magic, FIRETAIL_CAPTURE_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != FIRETAIL_CAPTURE_VERSION || header->header_size != sizeof(FiretailCaptureFileHeader) ||
+      header->data_size == 0 || (uint64_t)capture_stat.st_size != header->header_size + header->data_size) {
+    fprintf(stderr, "%s is not a FireTail capture file\n", path);
+    return NULL;
+  }
+
+  // Anything within a ring's length of where nginx had got to once the copy was complete hasn't been overwritten since
+  // the copy was started
+  FiretailCaptureFileHeader current_header;
+  if (pread(fd, &current_header, sizeof(current_header), 0) != (ssize_t)sizeof(current_header)) {
+    fprintf(stderr, "Failed to read %s\n", path);
+    return NULL;
+  }
+  close(fd);
+  *oldest_offset = current_header.write_offset > header->data_size
+                       ? FIRETAIL_CAPTURE_ALIGN(current_header.write_offset - header->data_size)
+                       : 0;
+
+  return header;
+}
+
+// Calls visit for every complete record in the ring, oldest first. Records that were being written when the capture
+// file was copied, were overwritten while it was copied or are otherwise corrupt are skipped.
+static size_t ForEachRecord(FiretailCaptureFileHeader *header, uint64_t oldest_offset,
+                            void (*visit)(FiretailCaptureRecordHeader *, void *), void *visit_data) {
+  unsigned char *data = (unsigned char *)header + header->header_size;
+  uint64_t end = header->write_offset;
+  uint64_t offset = end > header->data_size ? end - header->data_size : 0;
+  if (offset < oldest_offset) {
+    offset = oldest_offset;
+  }
+  size_t visited = 0;
+
+  while (offset < end) {
+    uint64_t position = offset % header->data_size;
+
+    // Space at the end of the ring too small for a record header is always skipped by writers
+    if (header->data_size - position < sizeof(FiretailCaptureRecordHeader)) {
+      offset += header->data_size - position;
+      continue;
+    }
+
+    // The oldest record may have been partly overwritten, so until we find a record whose offset matches where it is
+    // in the ring we step forward by the records' alignment
+    FiretailCaptureRecordHeader *record = (FiretailCaptureRecordHeader *)(data + position);
+    if ((record->magic != FIRETAIL_CAPTURE_RECORD_MAGIC && record->magic != FIRETAIL_CAPTURE_PADDING_MAGIC) ||
+        record->offset != offset || record->length < sizeof(FiretailCaptureRecordHeader) ||
+        record->length > header->data_size - position) {
+      offset += 8;
+      continue;
+    }
+
+    // The visitors find each part of the record from the lengths in its header, so they must all fit within it
+    uint64_t parts_length = (uint64_t)record->method_length + record->uri_length + record->request_headers_length +
+                            record->request_body_length + record->response_headers_length +
+                            record->response_body_length;
+    if (record->magic == FIRETAIL_CAPTURE_RECORD_MAGIC &&
+        parts_length > record->length - sizeof(FiretailCaptureRecordHeader)) {
+      offset += 8;
+      continue;
+    }
+
+    if (record->magic == FIRETAIL_CAPTURE_RECORD_MAGIC) {
+      visit(record, visit_data);
+      visited++;
+    }
+    offset += record->length;
+  }
+
+  return visited;
+}
+
+// How many bodies the native validators were checked against the validator with, how many they covered, how many
+// they found valid, and how many of those the validator found invalid
+typedef struct {
+  const char *name;
+  size_t checked;
+  size_t covered;
+  size_t valid;
+  size_t disagreements;
+} NativeComparison;
+
+// Only this many disagreements are printed in full
+#define MAX_PRINTED_DISAGREEMENTS 20
+
+// Mutations insert or substitute these, to produce bodies near the edges of what JSON and the appspec allow
+static const char *const kMutationTokens[] = {
+    "null", "true", "false", "0", "-1", "1.5", "1e1", "1e400", "2147483648", "01", "-", "1.", "\"\"", "\"a\"", "\"",
+    "\\", "\\u0041", "\\ud800", "[]", "{}", "[", "]", "{", "}", ",", ":", " ", "\xc3", "\xff", "\x01",
+};
+#define MUTATION_TOKEN_COUNT (sizeof(kMutationTokens) / sizeof(kMutationTokens[0]))
+#define MAX_MUTATION_TOKEN_LENGTH 10
+#define MAX_MUTATIONS_PER_BODY 3
+
+typedef struct {
+  ValidateRequestBody request_body_validator;
+  ValidateResponseBody response_body_validator;
+  ReleaseRequest request_releaser;
+  char *allow_undefined_routes;
+  EntryPointTimings request_timings;
+  EntryPointTimings response_timings;
+  // Only set when comparing native validators against the validator
+  FiretailNativeValidateRequestFunction native_request_validator;
+  FiretailNativeValidateResponseFunction native_response_validator;
+  long mutations;
+  uint64_t random_state;
+  EntryPointTimings native_request_timings;
+  EntryPointTimings native_response_timings;
+  NativeComparison request_comparison;
+  NativeComparison response_comparison;
+  // Only set when replaying requests in batches
+  ValidateRequestBodies request_bodies_validator;
+  RequestBatch batch;
+} Replay;
+
+static void ReplayRecord(FiretailCaptureRecordHeader *record, void *replay_data) {
+  Replay *replay = replay_data;
+
+  char *method = (char *)(record + 1);
+  char *uri = method + record->method_length;
+  char *request_headers = uri + record->uri_length;
+  char *request_body = request_headers + record->request_headers_length;
+  char *response_headers = request_body + record->request_body_length;
+  char *response_body = response_headers + record->response_headers_length;
+
+  // The module only validates the response if the request passed validation, so we do the same
+  double start = MonotonicUsec();
+  struct ValidateRequestBody_return request_result = replay->request_body_validator(
+      replay->allow_undefined_routes, strlen(replay->allow_undefined_routes), request_body,
+      record->request_body_length, uri, record->uri_length, method, record->method_length, request_headers,
+      record->request_headers_length, NULL, 0, record->request_body_length);
+  RecordTiming(&replay->request_timings, MonotonicUsec() - start, request_result.r0);
+  free(request_result.r1);
+  free(request_result.r2);
+  if (request_result.r0 > 0) {
+    return;
+  }
+
+  start = MonotonicUsec();
+  struct ValidateResponseBody_return response_result = replay->response_body_validator(
+      "", 0, "", 0, replay->allow_undefined_routes, strlen(replay->allow_undefined_routes), request_result.r3, NULL, 0,
+      NULL, 0, response_body, record->response_body_length, record->response_body_length,
+      record->response_headers_length ? response_headers : NULL, record->response_headers_length, NULL, 0, uri,
+      record->uri_length, record->status_code, method, record->method_length, 0);
+  RecordTiming(&replay->response_timings, MonotonicUsec() - start, response_result.r0);
+  free(response_result.r1);
+  if (request_result.r3 != 0) {
+    replay->request_releaser(request_result.r3);
+  }
+}
+
+static void FlushBatch(Replay *replay) {
+  RequestBatch *batch = &replay->batch;
+  if (batch->length == 0) {
+    return;
+  }
+
+  // The batch is validated one request at a time too, straight before, so both are timed in the same conditions
+  double start = MonotonicUsec();
+  for (size_t i = 0; i < batch->length; i++) {
+    FiretailRequestValidation *validation = &batch->validations[i];
+    struct ValidateRequestBody_return request_result = replay->request_body_validator(
+        replay->allow_undefined_routes, strlen(replay->allow_undefined_routes), validation->body,
+        validation->body_length, validation->path, validation->path_length, validation->method,
+        validation->method_length, validation->headers, validation->headers_length, NULL, 0,
+        validation->logged_body_length);
+    free(request_result.r1);
+    free(request_result.r2);
+    if (request_result.r3 != 0) {
+      replay->request_releaser(request_result.r3);
+    }
+  }
+  batch->unbatched_usec += MonotonicUsec() - start;
+
+  start = MonotonicUsec();
+  replay->request_bodies_validator(replay->allow_undefined_routes, strlen(replay->allow_undefined_routes),
+                                   batch->validations, batch->length);
+  batch->batched_usec += MonotonicUsec() - start;
+  batch->batches++;
+  batch->requests += batch->length;
+
+  for (size_t i = 0; i < batch->length; i++) {
+    FiretailRequestValidation *validation = &batch->validations[i];
+    batch->failures += validation->result > 0;
+    free(validation->response);
+    free(validation->operation_id);
+    if (validation->request_handle != 0) {
+      replay->request_releaser(validation->request_handle);
+    }
+  }
+  batch->length = 0;
+}
+
+static void BatchRecord(FiretailCaptureRecordHeader *record, void *replay_data) {
+  Replay *replay = replay_data;
+
+  char *method = (char *)(record + 1);
+  char *uri = method + record->method_length;
+  char *request_headers = uri + record->uri_length;
+  char *request_body = request_headers + record->request_headers_length;
+
+  replay->batch.validations[replay->batch.length++] = (FiretailRequestValidation){
+      .body = request_body,
+      .body_length = record->request_body_length,
+      .path = uri,
+      .path_length = record->uri_length,
+      .method = method,
+      .method_length = record->method_length,
+      .headers = request_headers,
+      .headers_length = record->request_headers_length,
+      .logged_body_length = record->request_body_length,
+  };
+  if (replay->batch.length == replay->batch.size) {
+    FlushBatch(replay);
+  }
+}
+
+// Parses the comma separated list of batch sizes given with -b, returning how many there are or 0 if it's invalid
+static size_t ParseBatchSizes(char *list, size_t *batch_sizes) {
+  size_t count = 0;
+  for (char *size = strtok(list, ","); size != NULL; size = strtok(NULL, ",")) {
+    char *end;
+    long batch_size = strtol(size, &end, 10);
+    if (*end != '\0' || batch_size < 1 || batch_size > INT32_MAX || count == MAX_BATCH_SIZES) {
+      return 0;
+    }
+    batch_sizes[count++] = batch_size;
+  }
+  return count;
+}
+
+// xorshift64*, so a run's mutations can be repeated by giving the same seed
+static uint64_t NextRandom(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Writes a randomly mutated copy of the body to mutated, which must have room for the body plus
+// MAX_MUTATIONS_PER_BODY * MAX_MUTATION_TOKEN_LENGTH bytes, and returns its length
+static size_t MutateBody(const char *body, size_t body_length, char *mutated, uint64_t *random_state) {
+  memcpy(mutated, body, body_length);
+  size_t length = body_length;
+
+  int mutation_count = 1 + NextRandom(random_state) % MAX_MUTATIONS_PER_BODY;
+  for (int i = 0; i < mutation_count; i++) {
+    size_t position = NextRandom(random_state) % (length + 1);
+    const char *token = kMutationTokens[NextRandom(random_state) % MUTATION_TOKEN_COUNT];
+    size_t token_length = strlen(token);
+    switch (NextRandom(random_state) % 5) {
+      case 0:  // Delete a byte
+        if (position < length) {
+          memmove(mutated + position, mutated + position + 1, length - position - 1);
+          length--;
+        }
+        break;
+      case 1:  // Insert a token
+        memmove(mutated + position + token_length, mutated + position, length - position);
+        memcpy(mutated + position, token, token_length);
+        length += token_length;
+        break;
+      case 2: {  // Replace a span with a token
+        size_t span_length = NextRandom(random_state) % (length - position + 1);
+        memmove(mutated + position + token_length, mutated + position + span_length, length - position - span_length);
+        memcpy(mutated + position, token, token_length);
+        length = length - span_length + token_length;
+        break;
+      }
+      case 3:  // Truncate
+        length = position;
+        break;
+      case 4:  // Overwrite a byte
+        if (position < length) {
+          mutated[position] = (char)NextRandom(random_state);
+        }
+        break;
+    }
+  }
+
+  return length;
+}
+
+// Finds the Content-Type in a captured request or response's headers JSON, which maps each header's name to a string
+// or a list of strings. Only the escape sequences json-c writes in media types are handled.
+static size_t FindContentType(const char *headers, size_t headers_length, char *content_type, size_t capacity) {
+  static const char kKey[] = "\"content-type\"";
+  size_t key_length = sizeof(kKey) - 1;
+  const char *end = headers + headers_length;
+  for (const char *key = headers; key + key_length <= end; key++) {
+    if (strncasecmp(key, kKey, key_length) != 0) {
+      continue;
+    }
+    const char *position = key + key_length;
+    while (position < end && (*position == ' ' || *position == ':' || *position == '[')) {
+      position++;
+    }
+    if (position == end || *position != '"') {
+      return 0;
+    }
+    size_t length = 0;
+    for (position++; position < end && *position != '"' && length < capacity; position++) {
+      if (*position == '\\' && position + 1 < end) {
+        position++;
+      }
+      content_type[length++] = *position;
+    }
+    return length;
+  }
+  return 0;
+}
+
+static void ReportDisagreement(NativeComparison *comparison, const char *method, size_t method_length,
+                               const char *uri, size_t uri_length, const char *body, size_t body_length,
+                               const char *error) {
+  if (comparison->disagreements++ >= MAX_PRINTED_DISAGREEMENTS) {
+    return;
+  }
+  int printed_body_length = body_length < 512 ? (int)body_length : 512;
+  printf("%s: the native validators passed a body the validator failed: %.*s %.*s\n  body: %.*s\n  error: %s\n",
+         comparison->name, (int)method_length, method, (int)uri_length, uri, printed_body_length, body,
+         error != NULL ? error : "");
+}
+
+// Compares the native validators with the validator on the record's request & response bodies, and the given
+// number of mutations of each
+static void CompareRecord(FiretailCaptureRecordHeader *record, void *replay_data) {
+  Replay *replay = replay_data;
+
+  char *method = (char *)(record + 1);
+  char *uri = method + record->method_length;
+  char *request_headers = uri + record->uri_length;
+  char *request_body = request_headers + record->request_headers_length;
+  char *response_headers = request_body + record->request_body_length;
+  char *response_body = response_headers + record->response_headers_length;
+
+  char request_content_type[256], response_content_type[256];
+  size_t request_content_type_length = FindContentType(request_headers, record->request_headers_length,
+                                                       request_content_type, sizeof(request_content_type));
+  size_t response_content_type_length = FindContentType(response_headers, record->response_headers_length,
+                                                        response_content_type, sizeof(response_content_type));
+
+  size_t longest_body_length = record->request_body_length > record->response_body_length
+                                   ? record->request_body_length
+                                   : record->response_body_length;
+  char *mutated = malloc(longest_body_length + MAX_MUTATIONS_PER_BODY * MAX_MUTATION_TOKEN_LENGTH);
+  if (mutated == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  for (long i = 0; i <= replay->mutations; i++) {
+    const char *body = request_body;
+    size_t body_length = record->request_body_length;
+    if (i > 0) {
+      body_length = MutateBody(request_body, record->request_body_length, mutated, &replay->random_state);
+      body = mutated;
+    }
+
+    const char *operation_id;
+    double start = MonotonicUsec();
+    int native_result =
+        replay->native_request_validator(method, record->method_length, uri, record->uri_length, request_content_type,
+                                         request_content_type_length, body, body_length, &operation_id);
+    RecordTiming(&replay->native_request_timings, MonotonicUsec() - start, native_result == FIRETAIL_NATIVE_INVALID);
+    replay->request_comparison.checked++;
+    replay->request_comparison.covered += native_result != FIRETAIL_NATIVE_NOT_COVERED;
+    if (native_result != FIRETAIL_NATIVE_VALID) {
+      continue;
+    }
+    replay->request_comparison.valid++;
+
+    start = MonotonicUsec();
+    struct ValidateRequestBody_return request_result = replay->request_body_validator(
+        replay->allow_undefined_routes, strlen(replay->allow_undefined_routes), (char *)body, body_length, uri,
+        record->uri_length, method, record->method_length, request_headers, record->request_headers_length, NULL, 0,
+        body_length);
+    RecordTiming(&replay->request_timings, MonotonicUsec() - start, request_result.r0);
+    if (request_result.r0 > 0) {
+      ReportDisagreement(&replay->request_comparison, method, record->method_length, uri, record->uri_length, body,
+                         body_length, request_result.r1);
+    }
+    free(request_result.r1);
+    free(request_result.r2);
+    if (request_result.r3 != 0) {
+      replay->request_releaser(request_result.r3);
+    }
+  }
+
+  for (long i = 0; i <= replay->mutations; i++) {
+    const char *body = response_body;
+    size_t body_length = record->response_body_length;
+    if (i > 0) {
+      body_length = MutateBody(response_body, record->response_body_length, mutated, &replay->random_state);
+      body = mutated;
+    }
+
+    double start = MonotonicUsec();
+    int native_result = replay->native_response_validator(
+        method, record->method_length, uri, record->uri_length, record->status_code, response_content_type,
+        response_content_type_length, body, body_length);
+    RecordTiming(&replay->native_response_timings, MonotonicUsec() - start, native_result == FIRETAIL_NATIVE_INVALID);
+    replay->response_comparison.checked++;
+    replay->response_comparison.covered += native_result != FIRETAIL_NATIVE_NOT_COVERED;
+    if (native_result != FIRETAIL_NATIVE_VALID) {
+      continue;
+    }
+    replay->response_comparison.valid++;
+
+    // The request is passed directly rather than by a handle, as it is when the native validators passed it
+    start = MonotonicUsec();
+    struct ValidateResponseBody_return response_result = replay->response_body_validator(
+        "", 0, "", 0, replay->allow_undefined_routes, strlen(replay->allow_undefined_routes), 0, request_body,
+        record->request_body_length, request_headers, record->request_headers_length, (char *)body, body_length,
+        body_length, record->response_headers_length ? response_headers : NULL, record->response_headers_length, NULL,
+        0, uri, record->uri_length, record->status_code, method, record->method_length, 0);
+    RecordTiming(&replay->response_timings, MonotonicUsec() - start, response_result.r0);
+    if (response_result.r0 > 0) {
+      ReportDisagreement(&replay->response_comparison, method, record->method_length, uri, record->uri_length, body,
+                         body_length, response_result.r1);
+    }
+    free(response_result.r1);
+  }
+
+  free(mutated);
+}
+
+static void PrintComparison(NativeComparison *comparison) {
+  printf("%-20s checked=%zu covered=%zu native_valid=%zu disagreements=%zu\n", comparison->name, comparison->checked,
+         comparison->covered, comparison->valid, comparison->disagreements);
+}
+
+static void PrintUsage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [-v validator.so] [-a allow_undefined_routes] [-n passes] [-d native_validators.so "
+          "[-f mutations] [-s seed]] [-b batch_size,...] capture_file\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  const char *validator_path = "/etc/nginx/modules/firetail-validator.so";
+  const char *native_validators_path = NULL;
+  long passes = 1;
+  size_t batch_sizes[MAX_BATCH_SIZES];
+  size_t batch_size_count = 0;
+  Replay replay = {
+      .allow_undefined_routes = "false",
+      .request_timings = {.name = "ValidateRequestBody"},
+      .response_timings = {.name = "ValidateResponseBody"},
+      .random_state = 1,
+      .native_request_timings = {.name = "NativeRequest"},
+      .native_response_timings = {.name = "NativeResponse"},
+      .request_comparison = {.name = "requests"},
+      .response_comparison = {.name = "responses"},
+  };
+
+  int option;
+  while ((option = getopt(argc, argv, "v:a:n:d:f:s:b:")) != -1) {
+    switch (option) {
+      case 'v':
+        validator_path = optarg;
+        break;
+      case 'a':
+        replay.allow_undefined_routes = optarg;
+        break;
+      case 'n':
+        passes = strtol(optarg, NULL, 10);
+        break;
+      case 'd':
+        native_validators_path = optarg;
+        break;
+      case 'f':
+        replay.mutations = strtol(optarg, NULL, 10);
+        break;
+      case 's':
+        // xorshift's state must never be zero
+        replay.random_state = strtoull(optarg, NULL, 10) | 1;
+        break;
+      case 'b':
+        batch_size_count = ParseBatchSizes(optarg, batch_sizes);
+        if (batch_size_count == 0) {
+          PrintUsage(argv[0]);
+          return 2;
+        }
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1 || passes < 1 || replay.mutations < 0) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  uint64_t oldest_offset;
+  FiretailCaptureFileHeader *header = ReadCaptureFile(argv[optind], &oldest_offset);
+  if (header == NULL) {
+    return 1;
+  }
+
+  void *validator_module = dlopen(validator_path, RTLD_LAZY);
+  if (validator_module == NULL) {
+    fprintf(stderr, "Failed to load validator: %s\n", dlerror());
+    return 1;
+  }
+  replay.request_body_validator = (ValidateRequestBody)dlsym(validator_module, "ValidateRequestBody");
+  replay.response_body_validator = (ValidateResponseBody)dlsym(validator_module, "ValidateResponseBody");
+  replay.request_releaser = (ReleaseRequest)dlsym(validator_module, "ReleaseRequest");
+  if (replay.request_body_validator == NULL || replay.response_body_validator == NULL ||
+      replay.request_releaser == NULL) {
+    fprintf(stderr, "Failed to load validator entry points: %s\n", dlerror());
+    return 1;
+  }
+  if (batch_size_count > 0) {
+    replay.request_bodies_validator = (ValidateRequestBodies)dlsym(validator_module, "ValidateRequestBodies");
+    if (replay.request_bodies_validator == NULL) {
+      fprintf(stderr, "Failed to load ValidateRequestBodies: %s\n", dlerror());
+      return 1;
+    }
+  }
+
+  if (native_validators_path != NULL) {
+    void *native_module = dlopen(native_validators_path, RTLD_NOW);
+    if (native_module == NULL) {
+      fprintf(stderr, "Failed to load native validators: %s\n", dlerror());
+      return 1;
+    }
+    replay.native_request_validator =
+        (FiretailNativeValidateRequestFunction)dlsym(native_module, FIRETAIL_NATIVE_VALIDATE_REQUEST_SYMBOL);
+    replay.native_response_validator =
+        (FiretailNativeValidateResponseFunction)dlsym(native_module, FIRETAIL_NATIVE_VALIDATE_RESPONSE_SYMBOL);
+    if (replay.native_request_validator == NULL || replay.native_response_validator == NULL) {
+      fprintf(stderr, "Failed to load native validator entry points: %s\n", dlerror());
+      return 1;
+    }
+
+    size_t records = 0;
+    for (long pass = 0; pass < passes; pass++) {
+      records = ForEachRecord(header, oldest_offset, CompareRecord, &replay);
+    }
+    printf("compared %zu records %ld times with %ld mutations each\n", records, passes, replay.mutations);
+    PrintComparison(&replay.request_comparison);
+    PrintComparison(&replay.response_comparison);
+    PrintTimings(&replay.native_request_timings);
+    PrintTimings(&replay.native_response_timings);
+    PrintTimings(&replay.request_timings);
+    PrintTimings(&replay.response_timings);
+    return replay.request_comparison.disagreements + replay.response_comparison.disagreements > 0;
+  }
+
+  size_t records = 0;
+  double start = MonotonicUsec();
+  for (long pass = 0; pass < passes; pass++) {
+    records = ForEachRecord(header, oldest_offset, ReplayRecord, &replay);
+  }
+  double elapsed_usec = MonotonicUsec() - start;
+
+  printf("replayed %zu records %ld times in %.3fs (%.0f exchanges/s)\n", records, passes, elapsed_usec / 1e6,
+         records * passes / (elapsed_usec / 1e6));
+
+  PrintTimings(&replay.request_timings);
+  PrintTimings(&replay.response_timings);
+
+  for (size_t i = 0; i < batch_size_count; i++) {
+    RequestBatch *batch = &replay.batch;
+    *batch = (RequestBatch){.size = batch_sizes[i]};
+    batch->validations = malloc(batch->size * sizeof(FiretailRequestValidation));
+    if (batch->validations == NULL) {
+      perror("malloc");
+      return 1;
+    }
+    for (long pass = 0; pass < passes; pass++) {
+      ForEachRecord(header, oldest_offset, BatchRecord, &replay);
+    }
+    FlushBatch(&replay);
+    free(batch->validations);
+
+    if (batch->requests == 0) {
+      printf("batch=%-14zu no calls\n", batch->size);
+      continue;
+    }
+    printf("batch=%-14zu calls=%zu failures=%zu unbatched=%.1fus/request batched=%.1fus/request saved=%.1fus/request "
+           "requests/s=%.0f\n",
+           batch->size, batch->batches, batch->failures, batch->unbatched_usec / batch->requests,
+           batch->batched_usec / batch->requests, (batch->unbatched_usec - batch->batched_usec) / batch->requests,
+           batch->requests / (batch->batched_usec / 1e6));
+  }
+
+  return 0;
+}
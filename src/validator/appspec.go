@@ -0,0 +1,286 @@
+package main
+
+import (
+	"C"
+	"crypto/md5"
+	"crypto/sha256"
+	"log"
+	"net/http"
+	"os"
+	"path/filepath"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	firetail "github.com/FireTail-io/firetail-go-lib/middlewares/http"
+	"github.com/getkin/kin-openapi/openapi3"
+	"github.com/getkin/kin-openapi/routers"
+	"github.com/getkin/kin-openapi/routers/gorillamux"
+)
+
+const appspecPath = "/etc/nginx/appspec.yml"
+
+// The prefix of the names of the snapshots of the appspec written beside it to compile it, which the watcher ignores
+const appspecSnapshotPrefix = ".firetail-snapshot-"
+
+// How long to wait after the appspec changes before reloading it, so a burst of writes only causes one reload
+const appspecReloadDelay = 250 * time.Millisecond
+
+// appspec holds everything compiled from one version of the appspec. Once it's been made current it's never modified,
+// so a validation which loaded it can finish with it even if a newer version is swapped in part way through.
+type appspec struct {
+	// The options for each middleware are nil until the validator it's used by is first called
+	requestOptions    *firetail.Options
+	responseOptions   *firetail.Options
+	requestMiddleware func(next http.Handler) http.Handler
+	// The response middleware only validates responses, so that they can be validated with all of their headers but
+	// logged with nginx's capture policy applied by the response logging middleware. That's nil if there's no API token
+	// to log them with.
+	responseMiddleware        func(next http.Handler) http.Handler
+	responseLoggingMiddleware func(next http.Handler) http.Handler
+	router                    routers.Router
+	// The operation IDs the router has found, which are replaced along with it
+	operationIds *operationIdCache
+	hash         [sha256.Size]byte
+	// The MD5 of the appspec is what native validators embed to say which appspec they were generated from
+	md5 [md5.Size]byte
+}
+
+// The most requests whose operation ID is cached for each version of the appspec. Paths with parameters in them would
+// otherwise grow the cache without bound.
+const operationIdCacheSize = 4096
+
+// operationIdCache holds the operation ID found for each method & path, so the router only has to find the route for
+// each of them once. Finding a route means trying each of the appspec's paths in turn, which would otherwise be done
+// for every request on top of the middleware finding it again to validate the request.
+type operationIdCache struct {
+	operationIds sync.Map // of the method, host & path to a cachedOperationId
+	length       atomic.Int64
+}
+
+type cachedOperationId struct {
+	operationId string
+	found       bool
+}
+
+var currentAppspec atomic.Pointer[appspec]
+
+// Serialises compiling new versions of the appspec, so they're swapped in one at a time
+var appspecMutex sync.Mutex
+
+var appspecWatchOnce sync.Once
+var appspecReloadTimer *time.Timer
+var appspecReloadTimerMutex sync.Mutex
+
+// updateAppspec copies the current appspec, applies update to the copy and makes it current, unless update fails in
+// which case the current appspec is kept
+func updateAppspec(update func(next *appspec) error) (*appspec, error) {
+	appspecMutex.Lock()
+	defer appspecMutex.Unlock()
+
+	next := &appspec{}
+	if current := currentAppspec.Load(); current != nil {
+		*next = *current
+	}
+	if err := update(next); err != nil {
+		return nil, err
+	}
+	currentAppspec.Store(next)
+	publishAppspecVersion(next)
+
+	// Now there's an appspec in use we can start watching for changes to it
+	appspecWatchOnce.Do(func() {
+		if err := watchAppspec(appspecPath, scheduleAppspecReload); err != nil {
+			log.Println("Failed to watch appspec for changes, err:", err.Error())
+		}
+	})
+
+	return next, nil
+}
+
+// getRequestAppspec returns the current appspec, first compiling its request middleware with the given options if
+// it hasn't been already
+func getRequestAppspec(options func() *firetail.Options) (*appspec, error) {
+	if current := currentAppspec.Load(); current != nil && current.requestMiddleware != nil {
+		return current, nil
+	}
+	return updateAppspec(func(next *appspec) error {
+		if next.requestMiddleware != nil {
+			return nil
+		}
+		next.requestOptions = options()
+		return next.compile()
+	})
+}
+
+// getResponseAppspec returns the current appspec, first compiling its response middleware with the given options if
+// it hasn't been already
+func getResponseAppspec(options func() *firetail.Options) (*appspec, error) {
+	if current := currentAppspec.Load(); current != nil && current.responseMiddleware != nil {
+		return current, nil
+	}
+	return updateAppspec(func(next *appspec) error {
+		if next.responseMiddleware != nil {
+			return nil
+		}
+		next.responseOptions = options()
+		return next.compile()
+	})
+}
+
+// compile (re)creates the middlewares that have options, and the router, from the appspec file
+func (a *appspec) compile() error {
+	appspecBytes, err := os.ReadFile(appspecPath)
+	if err != nil {
+		return err
+	}
+	return a.compileFrom(appspecBytes)
+}
+
+// compileFrom (re)creates the middlewares that have options, and the router, from one version of the appspec's
+// contents, so they can't disagree with each other or with the hash if the appspec changes while they're created
+func (a *appspec) compileFrom(appspecBytes []byte) error {
+	a.hash = sha256.Sum256(appspecBytes)
+	a.md5 = md5.Sum(appspecBytes)
+
+	// firetail-go-lib only loads appspecs from files, so its middlewares load a snapshot of the contents we've read
+	snapshotPath, err := writeAppspecSnapshot(appspecBytes)
+	if err != nil {
+		return err
+	}
+	defer os.Remove(snapshotPath)
+	getMiddleware := func(options firetail.Options) (func(next http.Handler) http.Handler, error) {
+		options.OpenapiSpecPath = snapshotPath
+		return firetail.GetMiddleware(&options)
+	}
+
+	if a.requestOptions != nil {
+		if a.requestMiddleware, err = getMiddleware(*a.requestOptions); err != nil {
+			return err
+		}
+	}
+	if a.responseOptions != nil {
+		validationOptions := *a.responseOptions
+		validationOptions.LogsApiToken = ""
+		if a.responseMiddleware, err = getMiddleware(validationOptions); err != nil {
+			return err
+		}
+
+		// firetail-go-lib gives us no way to stop a middleware's logger, so if the logging middleware were recreated
+		// with each version of the appspec the old ones would be left running. It's only used to log exchanges that
+		// have already been validated, so it's created once and kept, with the version of the appspec it was created
+		// from. It allows undefined routes so that exchanges on routes added to the appspec since are still logged,
+		// rather than logged as errors.
+		if a.responseOptions.LogsApiToken != "" && a.responseLoggingMiddleware == nil {
+			loggingOptions := *a.responseOptions
+			loggingOptions.EnableResponseValidation = false
+			loggingOptions.AllowUndefinedRoutes = true
+			if a.responseLoggingMiddleware, err = getMiddleware(loggingOptions); err != nil {
+				return err
+			}
+		}
+	}
+
+	// The router is only used to find the operation ID, so if it fails to load we can continue with the last one
+	if router, err := loadRouter(appspecBytes); err != nil {
+		log.Println("Failed to load appspec routes, err:", err.Error())
+	} else {
+		a.router = router
+		a.operationIds = &operationIdCache{}
+	}
+
+	return nil
+}
+
+// writeAppspecSnapshot writes the appspec's contents to a new file beside it, so any relative references in it resolve
+// as they would from the appspec itself, or to the temp directory if we can't write beside it. It returns the file's
+// path, and the file should be removed once it's been loaded.
+func writeAppspecSnapshot(appspecBytes []byte) (string, error) {
+	pattern := appspecSnapshotPrefix + "*" + filepath.Ext(appspecPath)
+	file, err := os.CreateTemp(filepath.Dir(appspecPath), pattern)
+	if err != nil {
+		if file, err = os.CreateTemp("", pattern); err != nil {
+			return "", err
+		}
+	}
+	_, err = file.Write(appspecBytes)
+	if closeErr := file.Close(); err == nil {
+		err = closeErr
+	}
+	if err != nil {
+		os.Remove(file.Name())
+		return "", err
+	}
+	return file.Name(), nil
+}
+
+// scheduleAppspecReload reloads the appspec once it's stopped changing for appspecReloadDelay
+func scheduleAppspecReload() {
+	appspecReloadTimerMutex.Lock()
+	defer appspecReloadTimerMutex.Unlock()
+	if appspecReloadTimer == nil {
+		appspecReloadTimer = time.AfterFunc(appspecReloadDelay, reloadAppspec)
+	} else {
+		appspecReloadTimer.Reset(appspecReloadDelay)
+	}
+}
+
+// reloadAppspec compiles the appspec file and swaps it in if its contents have changed. Validations already in
+// progress finish with the appspec they started with. If the new version fails to compile the current one is kept.
+func reloadAppspec() {
+	appspecBytes, err := os.ReadFile(appspecPath)
+	if err != nil {
+		log.Println("Failed to read appspec for reload, keeping the current version, err:", err.Error())
+		return
+	}
+	if current := currentAppspec.Load(); current != nil && current.hash == sha256.Sum256(appspecBytes) {
+		return
+	}
+
+	if _, err := updateAppspec(func(next *appspec) error { return next.compileFrom(appspecBytes) }); err != nil {
+		log.Println("Failed to reload appspec, keeping the current version, err:", err.Error())
+		return
+	}
+	log.Println("Reloaded appspec from", appspecPath)
+}
+
+// loadRouter creates a router for the operations in the appspec, so we can tell nginx which operation a request matched
+func loadRouter(appspecBytes []byte) (routers.Router, error) {
+	doc, err := openapi3.NewLoader().LoadFromData(appspecBytes)
+	if err != nil {
+		return nil, err
+	}
+	return gorillamux.NewRouter(doc)
+}
+
+// getOperationId returns the operationId of the operation in the appspec the request matches, or its method and path
+// if it has no operationId. If the request doesn't match any operation it returns nil.
+func (a *appspec) getOperationId(request *http.Request) *C.char {
+	if a.router == nil {
+		return nil
+	}
+
+	key := request.Method + " " + request.Host + request.URL.EscapedPath()
+	cached, ok := a.operationIds.operationIds.Load(key)
+	if !ok {
+		operationId := cachedOperationId{}
+		if route, _, err := a.router.FindRoute(request); err == nil {
+			operationId.found = true
+			operationId.operationId = route.Method + " " + route.Path
+			if route.Operation != nil && route.Operation.OperationID != "" {
+				operationId.operationId = route.Operation.OperationID
+			}
+		}
+		if a.operationIds.length.Load() < operationIdCacheSize {
+			if _, loaded := a.operationIds.operationIds.LoadOrStore(key, operationId); !loaded {
+				a.operationIds.length.Add(1)
+			}
+		}
+		cached = operationId
+	}
+
+	if operationId := cached.(cachedOperationId); operationId.found {
+		return C.CString(operationId.operationId)
+	}
+	return nil
+}
@@ -0,0 +1,52 @@
+package main
+
+/*
+#include <stdint.h>
+
+// Where the validator publishes the MD5 of the appspec it's using, so the nginx module can check its native validators
+// were generated from the same appspec without calling into Go. sequence is odd while md5 is being written, so readers
+// retry or give up if it's odd or changes while they read md5. The nginx module declares the same struct in
+// native_validation.c.
+typedef struct {
+	uint64_t sequence;
+	char md5[32];
+} FiretailAppspecVersion;
+*/
+import "C"
+
+import (
+	"encoding/hex"
+	"sync/atomic"
+	"unsafe"
+)
+
+// Where to publish the MD5 of each version of the appspec as it's made current, guarded by appspecMutex
+var appspecVersion *C.FiretailAppspecVersion
+
+// ReportAppspecVersion has the MD5 of the appspec written to version whenever a new version of it is made current,
+// starting with the current one if there is one. version must never be freed.
+//
+//export ReportAppspecVersion
+func ReportAppspecVersion(version *C.FiretailAppspecVersion) {
+	appspecMutex.Lock()
+	defer appspecMutex.Unlock()
+
+	appspecVersion = version
+	if current := currentAppspec.Load(); current != nil {
+		publishAppspecVersion(current)
+	}
+}
+
+// publishAppspecVersion writes a's MD5 to where ReportAppspecVersion was asked to, if it's been called. It must be
+// called with appspecMutex held.
+func publishAppspecVersion(a *appspec) {
+	if appspecVersion == nil {
+		return
+	}
+	sequence := (*uint64)(unsafe.Pointer(&appspecVersion.sequence))
+	md5 := unsafe.Slice((*byte)(unsafe.Pointer(&appspecVersion.md5[0])), len(appspecVersion.md5))
+
+	atomic.AddUint64(sequence, 1)
+	hex.Encode(md5, a.md5[:])
+	atomic.AddUint64(sequence, 1)
+}
@@ -0,0 +1,68 @@
+//go:build linux
+
+package main
+
+import (
+	"log"
+	"path/filepath"
+	"strings"
+	"syscall"
+	"unsafe"
+)
+
+// watchAppspec calls changed whenever anything in the appspec's directory changes. The directory is watched rather
+// than the file so we still see the appspec being replaced, e.g. by an editor or a Kubernetes ConfigMap update.
+func watchAppspec(path string, changed func()) error {
+	fd, err := syscall.InotifyInit1(syscall.IN_CLOEXEC)
+	if err != nil {
+		return err
+	}
+	_, err = syscall.InotifyAddWatch(
+		fd, filepath.Dir(path),
+		syscall.IN_CLOSE_WRITE|syscall.IN_CREATE|syscall.IN_DELETE|syscall.IN_MOVED_TO|syscall.IN_MOVED_FROM,
+	)
+	if err != nil {
+		syscall.Close(fd)
+		return err
+	}
+
+	go func() {
+		// We don't need to know what the events were as the appspec's contents are compared before it's reloaded, only
+		// that they weren't all for snapshots
+		events := make([]byte, 4096)
+		for {
+			n, err := syscall.Read(fd, events)
+			if err != nil {
+				if err == syscall.EINTR {
+					continue
+				}
+				log.Println("Stopped watching appspec for changes, err:", err.Error())
+				return
+			}
+			if !onlySnapshotsChanged(events[:n]) {
+				changed()
+			}
+		}
+	}()
+
+	return nil
+}
+
+// onlySnapshotsChanged returns whether the inotify events are all for the snapshots of the appspec written beside it to
+// compile it. Otherwise every worker's compile would schedule a reload in every other worker.
+func onlySnapshotsChanged(events []byte) bool {
+	for offset := 0; offset+syscall.SizeofInotifyEvent <= len(events); {
+		event := (*syscall.InotifyEvent)(unsafe.Pointer(&events[offset]))
+		nameStart := offset + syscall.SizeofInotifyEvent
+		nameEnd := nameStart + int(event.Len)
+		if nameEnd > len(events) {
+			nameEnd = len(events)
+		}
+		name := strings.TrimRight(string(events[nameStart:nameEnd]), "\x00")
+		if !strings.HasPrefix(name, appspecSnapshotPrefix) {
+			return false
+		}
+		offset = nameEnd
+	}
+	return true
+}
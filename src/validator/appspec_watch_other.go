@@ -0,0 +1,34 @@
+//go:build !linux
+
+package main
+
+import (
+	"os"
+	"time"
+)
+
+const appspecPollInterval = 2 * time.Second
+
+// watchAppspec calls changed whenever the appspec's modification time or size changes. inotify is only available on
+// Linux, so elsewhere we poll.
+func watchAppspec(path string, changed func()) error {
+	lastInfo, err := os.Stat(path)
+	if err != nil {
+		return err
+	}
+
+	go func() {
+		for range time.Tick(appspecPollInterval) {
+			info, err := os.Stat(path)
+			if err != nil {
+				continue
+			}
+			if !info.ModTime().Equal(lastInfo.ModTime()) || info.Size() != lastInfo.Size() {
+				lastInfo = info
+				changed()
+			}
+		}
+	}()
+
+	return nil
+}
@@ -0,0 +1,88 @@
+package main
+
+/*
+#include <stdint.h>
+
+// A request for ValidateRequestBodies to validate, and the results of validating it which are the same as those
+// ValidateRequestBody returns. The nginx module declares the same struct in validation_batch.h.
+typedef struct {
+	void *body;
+	int body_length;
+	void *path;
+	int path_length;
+	void *method;
+	int method_length;
+	void *headers;
+	int headers_length;
+	void *logged_headers;
+	int logged_headers_length;
+	int logged_body_length;
+	int result;
+	char *response;
+	char *operation_id;
+	uintptr_t request_handle;
+} FiretailRequestValidation;
+*/
+import "C"
+
+import (
+	"runtime"
+	"sync"
+	"sync/atomic"
+	"unsafe"
+)
+
+// ValidateRequestBodies validates a batch of requests nginx has queued up, so that nginx only has to call into Go once
+// for all of them rather than once per request. They're validated in parallel by up to GOMAXPROCS goroutines, one of
+// which is the goroutine nginx called us on, as handing each request to a goroutine of its own costs more in thread
+// wakeups than the calls into Go that batching saves.
+//
+//export ValidateRequestBodies
+func ValidateRequestBodies(
+	allowUndefinedRoutes unsafe.Pointer, allowUndefinedRoutesLength C.int,
+	validationsPtr *C.FiretailRequestValidation, validationsLength C.int,
+) {
+	if validationsLength <= 0 {
+		return
+	}
+	validations := unsafe.Slice(validationsPtr, int(validationsLength))
+
+	var nextValidation atomic.Int64
+	validateRemaining := func() {
+		for {
+			i := int(nextValidation.Add(1) - 1)
+			if i >= len(validations) {
+				return
+			}
+			validation := &validations[i]
+			result, response, operationId, requestHandle := ValidateRequestBody(
+				allowUndefinedRoutes, allowUndefinedRoutesLength,
+				validation.body, validation.body_length,
+				validation.path, validation.path_length,
+				validation.method, validation.method_length,
+				validation.headers, validation.headers_length,
+				validation.logged_headers, validation.logged_headers_length,
+				validation.logged_body_length,
+			)
+			validation.result = result
+			validation.response = response
+			validation.operation_id = operationId
+			validation.request_handle = C.uintptr_t(requestHandle)
+		}
+	}
+
+	workers := runtime.GOMAXPROCS(0)
+	if workers > len(validations) {
+		workers = len(validations)
+	}
+	var waitGroup sync.WaitGroup
+	waitGroup.Add(workers - 1)
+	for i := 1; i < workers; i++ {
+		go func() {
+			defer waitGroup.Done()
+			validateRemaining()
+		}()
+	}
+	validateRemaining()
+	waitGroup.Wait()
+}
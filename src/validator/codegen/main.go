@@ -0,0 +1,602 @@
+// Command codegen generates C validators from an OpenAPI specification, which the FireTail NGINX module uses in place
+// of the Go validator for the operations they cover. Run it from src/validator, then compile its output with the
+// native validators' runtime:
+//
+//	go run ./codegen -spec /etc/nginx/appspec.yml -o native_validators.c
+//	cc -O2 -shared -fPIC -I ../native_validators -o firetail-native-validators.so \
+//		native_validators.c ../native_validators/native_runtime.c
+//
+// The generated validators only cover the subset of OpenAPI they can check exactly as the Go validator would. An
+// operation's request or response which uses anything else is marked as not covered, and left to the Go validator.
+package main
+
+import (
+	"bytes"
+	"crypto/md5"
+	"encoding/hex"
+	"flag"
+	"fmt"
+	"log"
+	"math"
+	"os"
+	"sort"
+	"strconv"
+	"strings"
+
+	"github.com/getkin/kin-openapi/openapi3"
+)
+
+// The generated objects track their required properties with a bit each in a uint64_t
+const maxObjectProperties = 64
+
+func main() {
+	specPath := flag.String("spec", "/etc/nginx/appspec.yml", "the OpenAPI specification to generate validators for")
+	outputPath := flag.String("o", "native_validators.c", "the C file to write the validators to")
+	flag.Parse()
+
+	specBytes, err := os.ReadFile(*specPath)
+	if err != nil {
+		log.Fatalln("Failed to read appspec, err:", err.Error())
+	}
+	doc, err := openapi3.NewLoader().LoadFromData(specBytes)
+	if err != nil {
+		log.Fatalln("Failed to load appspec, err:", err.Error())
+	}
+
+	g := &generator{doc: doc, schemaIds: map[*openapi3.Schema]int{}}
+	source := g.generate(md5.Sum(specBytes))
+	if err := os.WriteFile(*outputPath, source, 0644); err != nil {
+		log.Fatalln("Failed to write validators, err:", err.Error())
+	}
+	log.Printf("Generated %d operations from %s, of which %d requests & %d responses are covered", g.operationCount,
+		*specPath, g.coveredRequests, g.coveredResponses)
+}
+
+type generator struct {
+	doc *openapi3.T
+
+	// Each schema a validator is generated for is given an ID, which is used to name its function. Schemas are
+	// queued until their function is written, so schemas that reference themselves only get one function.
+	schemaIds    map[*openapi3.Schema]int
+	schemaQueue  []*openapi3.Schema
+	prototypes   bytes.Buffer
+	functions    bytes.Buffer
+	declarations bytes.Buffer
+
+	operationCount   int
+	coveredRequests  int
+	coveredResponses int
+}
+
+func (g *generator) generate(specMd5 [md5.Size]byte) []byte {
+	var operations bytes.Buffer
+
+	// Every operation is included, even if it isn't covered, so the runtime can tell when a path matches more than one
+	// path template and leave it to the Go validator's router to choose between them
+	paths := make([]string, 0, len(g.doc.Paths))
+	for path := range g.doc.Paths {
+		paths = append(paths, path)
+	}
+	sort.Strings(paths)
+	for pathIndex, path := range paths {
+		pathItem := g.doc.Paths[path]
+		segments, pathCovered := parsePath(path)
+		pathCovered = pathCovered && g.serversCovered() && len(pathItem.Servers) == 0
+
+		segmentsName := fmt.Sprintf("kFiretailSegments%d", pathIndex)
+		fmt.Fprintf(&g.declarations, "static const char *const %s[] = {%s};\n", segmentsName, strings.Join(segments, ", "))
+
+		pathOperations := pathItem.Operations()
+		methods := make([]string, 0, len(pathOperations))
+		for method := range pathOperations {
+			methods = append(methods, method)
+		}
+		sort.Strings(methods)
+		for _, method := range methods {
+			operation := pathOperations[method]
+			operationCovered := pathCovered && (operation.Servers == nil || len(*operation.Servers) == 0)
+
+			operationId := operation.OperationID
+			if operationId == "" {
+				operationId = method + " " + path
+			}
+
+			requestCovered, requestBodyRequired, requestBodyValidator := g.request(pathItem, operation)
+			requestCovered = requestCovered && operationCovered
+			if requestCovered {
+				g.coveredRequests++
+			}
+
+			responsesName, responseCount := g.responses(operation, operationCovered)
+
+			fmt.Fprintf(&operations, "    {%s, %s, %s, %d, %d, %d, %s, %s, %d},\n", cString(method), cString(operationId),
+				segmentsName, len(segments), boolInt(requestCovered), boolInt(requestBodyRequired), requestBodyValidator,
+				responsesName, responseCount)
+			g.operationCount++
+		}
+	}
+
+	// Write the validators for every schema the operations refer to, and any they refer to in turn
+	for len(g.schemaQueue) > 0 {
+		schema := g.schemaQueue[0]
+		g.schemaQueue = g.schemaQueue[1:]
+		g.writeSchemaValidator(schema)
+	}
+
+	var source bytes.Buffer
+	source.WriteString("// Code generated by src/validator/codegen. DO NOT EDIT.\n\n")
+	source.WriteString("#include \"native_runtime.h\"\n\n")
+	fmt.Fprintf(&source, "const char FiretailNativeAppspecMd5[] = \"%s\";\n\n", hex.EncodeToString(specMd5[:]))
+	if g.prototypes.Len() > 0 {
+		source.Write(g.prototypes.Bytes())
+		source.WriteString("\n")
+	}
+	source.Write(g.functions.Bytes())
+	source.Write(g.declarations.Bytes())
+	source.WriteString("\nconst FiretailNativeOperation FiretailNativeOperations[] = {\n")
+	if operations.Len() == 0 {
+		// C doesn't allow empty arrays, so an unused placeholder is written instead
+		operations.WriteString("    {0},\n")
+	}
+	source.Write(operations.Bytes())
+	source.WriteString("};\n\n")
+	fmt.Fprintf(&source, "const size_t FiretailNativeOperationCount = %d;\n", g.operationCount)
+	return source.Bytes()
+}
+
+// parsePath splits a path template into C string literals for its segments, with NULL for path parameters. Segments
+// which only partly consist of a path parameter can't be matched exactly, so they're treated as matching any segment,
+// which makes the runtime leave any path they might match to the Go validator, and the path is marked as not covered.
+func parsePath(path string) ([]string, bool) {
+	covered := true
+	var segments []string
+	for _, segment := range strings.Split(strings.TrimPrefix(path, "/"), "/") {
+		switch {
+		case isPathParameter(segment):
+			segments = append(segments, "NULL")
+		case strings.ContainsAny(segment, "{}"):
+			segments = append(segments, "NULL")
+			covered = false
+		default:
+			segments = append(segments, cString(segment))
+		}
+	}
+	return segments, covered
+}
+
+func isPathParameter(segment string) bool {
+	return len(segment) > 2 && segment[0] == '{' && segment[len(segment)-1] == '}' &&
+		!strings.ContainsAny(segment[1:len(segment)-1], "{}:")
+}
+
+// serversCovered returns true if the Go validator's router will match requests' paths against the path templates
+// alone, without a host or base path from the appspec's servers
+func (g *generator) serversCovered() bool {
+	for _, server := range g.doc.Servers {
+		if server.URL != "/" {
+			return false
+		}
+	}
+	return true
+}
+
+// request returns whether the operation's request is covered, whether its body is required, and the name of its
+// body's validator
+func (g *generator) request(pathItem *openapi3.PathItem, operation *openapi3.Operation) (bool, bool, string) {
+	// The Go validator needs an authentication function to check security requirements, which we can't replicate
+	security := g.doc.Security
+	if operation.Security != nil {
+		security = *operation.Security
+	}
+	if len(security) > 0 {
+		return false, false, "NULL"
+	}
+
+	// Path parameters are covered if any string is valid. Other parameters aren't covered.
+	parameters := append(append(openapi3.Parameters{}, pathItem.Parameters...), operation.Parameters...)
+	for _, parameterRef := range parameters {
+		parameter := parameterRef.Value
+		if parameter == nil || parameter.In != openapi3.ParameterInPath || len(parameter.Content) > 0 ||
+			parameter.Schema == nil || !isUnconstrainedString(parameter.Schema.Value) {
+			return false, false, "NULL"
+		}
+	}
+
+	if operation.RequestBody == nil {
+		return true, false, "NULL"
+	}
+	// Request bodies without any content aren't covered, as there's no content type the native validators can tell
+	// the Go validator would accept
+	requestBody := operation.RequestBody.Value
+	if requestBody == nil || len(requestBody.Content) == 0 {
+		return false, false, "NULL"
+	}
+	validator, covered := g.content(requestBody.Content)
+	return covered, covered && requestBody.Required, validator
+}
+
+// responses writes the operation's responses, returning the name of their array and how many there are
+func (g *generator) responses(operation *openapi3.Operation, operationCovered bool) (string, int) {
+	statuses := make([]string, 0, len(operation.Responses))
+	for status := range operation.Responses {
+		// Ranges of status codes aren't covered. As they'd be chosen over the default response none of the responses are
+		// written, so every response to the operation is left to the Go validator.
+		if status != "default" {
+			if _, err := strconv.Atoi(status); err != nil {
+				return "NULL", 0
+			}
+		}
+		statuses = append(statuses, status)
+	}
+	if len(statuses) == 0 {
+		return "NULL", 0
+	}
+	sort.Strings(statuses)
+
+	name := fmt.Sprintf("kFiretailResponses%d", g.operationCount)
+	fmt.Fprintf(&g.declarations, "static const FiretailNativeResponse %s[] = {\n", name)
+	for _, status := range statuses {
+		statusCode := 0
+		if status != "default" {
+			statusCode, _ = strconv.Atoi(status)
+		}
+
+		covered := false
+		validator := "NULL"
+		// Response headers aren't covered
+		if response := operation.Responses[status].Value; response != nil && len(response.Headers) == 0 {
+			validator, covered = g.content(response.Content)
+		}
+		covered = covered && operationCovered
+		if covered {
+			g.coveredResponses++
+		} else {
+			validator = "NULL"
+		}
+		fmt.Fprintf(&g.declarations, "    {%d, %d, %s},\n", statusCode, boolInt(covered), validator)
+	}
+	g.declarations.WriteString("};\n")
+	return name, len(statuses)
+}
+
+// content returns the name of the validator for a request or response body's content, which is NULL if there's no
+// content, and whether the content is covered. Content is only covered if it's JSON and nothing else. Responses
+// without any content are covered, as the Go validator accepts any body for them.
+func (g *generator) content(content openapi3.Content) (string, bool) {
+	if len(content) == 0 {
+		return "NULL", true
+	}
+	mediaType, ok := content["application/json"]
+	if !ok || len(content) != 1 || mediaType == nil {
+		return "NULL", false
+	}
+	// Without a schema the Go validator accepts any body, and the native validators any JSON
+	if mediaType.Schema == nil {
+		return "FiretailJsonSkipValue", true
+	}
+	if mediaType.Schema.Value == nil || !schemaCovered(mediaType.Schema.Value, map[*openapi3.Schema]bool{}) {
+		return "NULL", false
+	}
+	return g.schemaValidatorName(mediaType.Schema.Value), true
+}
+
+// schemaCovered returns true if the schema, and every schema it refers to, only use features the native validators
+// check exactly as the Go validator does
+func schemaCovered(schema *openapi3.Schema, visited map[*openapi3.Schema]bool) bool {
+	if visited[schema] {
+		return true
+	}
+	visited[schema] = true
+
+	if len(schema.OneOf) > 0 || len(schema.AnyOf) > 0 || len(schema.AllOf) > 0 || schema.Not != nil ||
+		schema.Pattern != "" || schema.MultipleOf != nil || schema.ReadOnly || schema.WriteOnly || schema.UniqueItems ||
+		schema.Discriminator != nil {
+		return false
+	}
+
+	switch schema.Type {
+	case "":
+		// Schemas without a type are only covered if they accept any value
+		return len(schema.Enum) == 0 && schema.Format == "" && schema.Min == nil && schema.Max == nil &&
+			schema.MinLength == 0 && schema.MaxLength == nil && schema.MinItems == 0 && schema.MaxItems == nil &&
+			schema.Items == nil && len(schema.Properties) == 0 && len(schema.Required) == 0 && schema.MinProps == 0 &&
+			schema.MaxProps == nil && schema.AdditionalProperties == nil && schema.AdditionalPropertiesAllowed == nil
+	case "string":
+		// The Go validator checks the enum before whether the schema's nullable, so null is only valid if it's in the
+		// enum as well. The native validators accept null before checking the enum, so they must agree on it.
+		hasNull := false
+		for _, value := range schema.Enum {
+			if value == nil {
+				hasNull = true
+			} else if _, ok := value.(string); !ok {
+				return false
+			}
+		}
+		if len(schema.Enum) > 0 && schema.Nullable != hasNull {
+			return false
+		}
+		return schema.Format == ""
+	case "integer":
+		return len(schema.Enum) == 0 && (schema.Format == "" || schema.Format == "int32" || schema.Format == "int64")
+	case "number":
+		return len(schema.Enum) == 0 && (schema.Format == "" || schema.Format == "double")
+	case "boolean":
+		return len(schema.Enum) == 0
+	case "array":
+		if len(schema.Enum) > 0 || (schema.Items != nil && schema.Items.Value == nil) {
+			return false
+		}
+		return schema.Items == nil || schemaCovered(schema.Items.Value, visited)
+	case "object":
+		if len(schema.Enum) > 0 || schema.AdditionalProperties != nil || schema.MinProps != 0 || schema.MaxProps != nil ||
+			len(objectMembers(schema)) > maxObjectProperties {
+			return false
+		}
+		for _, property := range schema.Properties {
+			if property == nil || property.Value == nil || !schemaCovered(property.Value, visited) {
+				return false
+			}
+		}
+		return true
+	}
+	return false
+}
+
+// isUnconstrainedString returns true if the schema accepts any string
+func isUnconstrainedString(schema *openapi3.Schema) bool {
+	return schema != nil && (schema.Type == "" || schema.Type == "string") && len(schema.Enum) == 0 &&
+		schema.MinLength == 0 && schema.MaxLength == nil && schemaCovered(schema, map[*openapi3.Schema]bool{})
+}
+
+// objectMembers returns the names of the object's properties and required properties, sorted
+func objectMembers(schema *openapi3.Schema) []string {
+	members := make([]string, 0, len(schema.Properties)+len(schema.Required))
+	for name := range schema.Properties {
+		members = append(members, name)
+	}
+	for _, name := range schema.Required {
+		if _, ok := schema.Properties[name]; !ok {
+			members = append(members, name)
+		}
+	}
+	sort.Strings(members)
+	return members
+}
+
+func additionalPropertiesAllowed(schema *openapi3.Schema) bool {
+	return schema.AdditionalPropertiesAllowed == nil || *schema.AdditionalPropertiesAllowed
+}
+
+// schemaValidatorName returns the name of the function validating the schema, queueing it to be written if it hasn't
+// been already. An empty schema accepts any value, so it's validated by skipping the value.
+func (g *generator) schemaValidatorName(schema *openapi3.Schema) string {
+	if schema.Type == "" && !schema.Nullable {
+		return "FiretailJsonSkipNonNullValue"
+	}
+	id, ok := g.schemaIds[schema]
+	if !ok {
+		id = len(g.schemaIds)
+		g.schemaIds[schema] = id
+		g.schemaQueue = append(g.schemaQueue, schema)
+		fmt.Fprintf(&g.prototypes, "static int FiretailSchema%d(FiretailJsonScanner *scanner);\n", id)
+	}
+	return fmt.Sprintf("FiretailSchema%d", id)
+}
+
+func (g *generator) writeSchemaValidator(schema *openapi3.Schema) {
+	w := &g.functions
+	fmt.Fprintf(w, "static int FiretailSchema%d(FiretailJsonScanner *scanner) {\n", g.schemaIds[schema])
+	if schema.Nullable {
+		w.WriteString("  if (FiretailJsonPeek(scanner) == 'n') {\n    return FiretailJsonLiteral(scanner, \"null\");\n  }\n")
+	}
+
+	switch schema.Type {
+	case "":
+		w.WriteString("  return FiretailJsonSkipValue(scanner);\n")
+	case "string":
+		g.writeStringValidator(schema)
+	case "integer", "number":
+		g.writeNumberValidator(schema)
+	case "boolean":
+		w.WriteString("  int c = FiretailJsonPeek(scanner);\n")
+		w.WriteString("  return c == 't' ? FiretailJsonLiteral(scanner, \"true\")\n")
+		w.WriteString("                  : c == 'f' && FiretailJsonLiteral(scanner, \"false\");\n")
+	case "array":
+		g.writeArrayValidator(schema)
+	case "object":
+		g.writeObjectValidator(schema)
+	}
+	w.WriteString("}\n\n")
+}
+
+func (g *generator) writeStringValidator(schema *openapi3.Schema) {
+	w := &g.functions
+	w.WriteString("  const char *start;\n  size_t raw_length, length;\n  int escaped;\n")
+	w.WriteString("  if (!FiretailJsonString(scanner, &start, &raw_length, &length, &escaped)) {\n    return 0;\n  }\n")
+	// Lengths are in code points, as the Go validator counts runes
+	if schema.MinLength > 0 {
+		fmt.Fprintf(w, "  if (length < %d) {\n    return 0;\n  }\n", schema.MinLength)
+	}
+	if schema.MaxLength != nil {
+		fmt.Fprintf(w, "  if (length > %d) {\n    return 0;\n  }\n", *schema.MaxLength)
+	}
+	if len(schema.Enum) > 0 {
+		// Strings with escape sequences are compared as they appear in the JSON, so they're left to the Go validator
+		w.WriteString("  if (escaped) {\n    return 0;\n  }\n")
+		values := make([]string, 0, len(schema.Enum))
+		for _, value := range schema.Enum {
+			// null has already been accepted, as the schema's nullable if it's in the enum
+			value, ok := value.(string)
+			if !ok {
+				continue
+			}
+			values = append(values, fmt.Sprintf("FiretailJsonKeyEquals(start, raw_length, %s, %d)", cString(value), len(value)))
+		}
+		if len(values) == 0 {
+			values = append(values, "0")
+		}
+		fmt.Fprintf(w, "  return %s;\n", strings.Join(values, " ||\n         "))
+		return
+	}
+	w.WriteString("  return 1;\n")
+}
+
+func (g *generator) writeNumberValidator(schema *openapi3.Schema) {
+	w := &g.functions
+	w.WriteString("  double value;\n  int is_integer;\n")
+	if schema.Type == "integer" {
+		w.WriteString("  if (!FiretailJsonNumber(scanner, &value, &is_integer) || !is_integer) {\n    return 0;\n  }\n")
+	} else {
+		w.WriteString("  if (!FiretailJsonNumber(scanner, &value, &is_integer)) {\n    return 0;\n  }\n")
+	}
+	if schema.Format == "int32" {
+		fmt.Fprintf(w, "  if (value < %s || value > %s) {\n    return 0;\n  }\n", cDouble(math.MinInt32),
+			cDouble(math.MaxInt32))
+	}
+	if schema.Min != nil {
+		operator := "<"
+		if schema.ExclusiveMin {
+			operator = "<="
+		}
+		fmt.Fprintf(w, "  if (value %s %s) {\n    return 0;\n  }\n", operator, cDouble(*schema.Min))
+	}
+	if schema.Max != nil {
+		operator := ">"
+		if schema.ExclusiveMax {
+			operator = ">="
+		}
+		fmt.Fprintf(w, "  if (value %s %s) {\n    return 0;\n  }\n", operator, cDouble(*schema.Max))
+	}
+	w.WriteString("  return 1;\n")
+}
+
+func (g *generator) writeArrayValidator(schema *openapi3.Schema) {
+	w := &g.functions
+	itemValidator := "FiretailJsonSkipValue"
+	if schema.Items != nil {
+		itemValidator = g.schemaValidatorName(schema.Items.Value)
+	}
+	w.WriteString("  if (!FiretailJsonBeginArray(scanner)) {\n    return 0;\n  }\n")
+	w.WriteString("  size_t count = 0;\n  int first = 1, more;\n")
+	w.WriteString("  while ((more = FiretailJsonNextElement(scanner, &first)) > 0) {\n")
+	fmt.Fprintf(w, "    if (!%s(scanner)) {\n      return 0;\n    }\n    count++;\n  }\n", itemValidator)
+	w.WriteString("  if (more < 0) {\n    return 0;\n  }\n")
+	if schema.MinItems > 0 {
+		fmt.Fprintf(w, "  if (count < %d) {\n    return 0;\n  }\n", schema.MinItems)
+	}
+	if schema.MaxItems != nil {
+		fmt.Fprintf(w, "  if (count > %d) {\n    return 0;\n  }\n", *schema.MaxItems)
+	}
+	w.WriteString("  return 1;\n")
+}
+
+func (g *generator) writeObjectValidator(schema *openapi3.Schema) {
+	w := &g.functions
+	required := map[string]bool{}
+	for _, name := range schema.Required {
+		required[name] = true
+	}
+
+	// Required properties that can't be present make the object invalid
+	for name := range required {
+		if _, isProperty := schema.Properties[name]; !isProperty && !additionalPropertiesAllowed(schema) {
+			w.WriteString("  return 0;\n")
+			return
+		}
+	}
+
+	w.WriteString("  if (!FiretailJsonBeginObject(scanner)) {\n    return 0;\n  }\n")
+	if len(required) > 0 {
+		w.WriteString("  uint64_t found = 0;\n")
+	}
+	w.WriteString("  const char *key;\n  size_t key_length;\n  int first = 1, more;\n")
+	w.WriteString("  while ((more = FiretailJsonNextMember(scanner, &first, &key, &key_length)) > 0) {\n")
+
+	var requiredMask uint64
+	branch := "    if"
+	for _, name := range objectMembers(schema) {
+		property, isProperty := schema.Properties[name]
+		// A required property that isn't defined can only be present if additional properties are allowed
+		if !isProperty && !additionalPropertiesAllowed(schema) {
+			continue
+		}
+		fmt.Fprintf(w, "%s (FiretailJsonKeyEquals(key, key_length, %s, %d)) {\n", branch, cString(name), len(name))
+		branch = "    } else if"
+		if required[name] {
+			bit := uint64(1) << (bits(requiredMask))
+			requiredMask |= bit
+			fmt.Fprintf(w, "      found |= UINT64_C(0x%x);\n", bit)
+		}
+		validator := "FiretailJsonSkipValue"
+		if isProperty {
+			validator = g.schemaValidatorName(property.Value)
+		}
+		fmt.Fprintf(w, "      if (!%s(scanner)) {\n        return 0;\n      }\n", validator)
+	}
+
+	additional := "      return 0;\n"
+	if additionalPropertiesAllowed(schema) {
+		additional = "      if (!FiretailJsonSkipValue(scanner)) {\n        return 0;\n      }\n"
+	}
+	if branch == "    if" {
+		w.WriteString(additional)
+	} else {
+		fmt.Fprintf(w, "    } else {\n%s    }\n", indent(additional))
+	}
+	w.WriteString("  }\n")
+
+	if requiredMask != 0 {
+		fmt.Fprintf(w, "  return more == 0 && found == UINT64_C(0x%x);\n", requiredMask)
+	} else {
+		w.WriteString("  return more == 0;\n")
+	}
+}
+
+// bits returns the number of bits set in the mask
+func bits(mask uint64) int {
+	count := 0
+	for ; mask != 0; mask &= mask - 1 {
+		count++
+	}
+	return count
+}
+
+func indent(code string) string {
+	return strings.ReplaceAll(strings.TrimSuffix(code, "\n"), "\n", "\n  ") + "\n"
+}
+
+func boolInt(value bool) int {
+	if value {
+		return 1
+	}
+	return 0
+}
+
+// cDouble formats the value as a C double literal which rounds to exactly the same value
+func cDouble(value float64) string {
+	literal := strconv.FormatFloat(value, 'g', -1, 64)
+	if !strings.ContainsAny(literal, ".eE") {
+		literal += ".0"
+	}
+	return literal
+}
+
+// cString formats the value as a C string literal, escaping anything but printable ASCII
+func cString(value string) string {
+	var literal strings.Builder
+	literal.WriteByte('"')
+	for i := 0; i < len(value); i++ {
+		c := value[i]
+		switch {
+		case c == '"' || c == '\\' || c == '?':
+			literal.WriteByte('\\')
+			literal.WriteByte(c)
+		case c < 0x20 || c >= 0x7f:
+			fmt.Fprintf(&literal, "\\%03o", c)
+		default:
+			literal.WriteByte(c)
+		}
+	}
+	literal.WriteByte('"')
+	return literal.String()
+}
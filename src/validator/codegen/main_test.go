@@ -0,0 +1,382 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"crypto/md5"
+	"encoding/hex"
+	"fmt"
+	"io"
+	"math/rand"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"testing"
+
+	firetail "github.com/FireTail-io/firetail-go-lib/middlewares/http"
+	"github.com/getkin/kin-openapi/openapi3"
+)
+
+const testAppspecPath = "testdata/appspec.json"
+
+// The verdicts of the generated validators, from src/nginx_module/native_validator.h
+const (
+	nativeValid      = 0
+	nativeInvalid    = 1
+	nativeNotCovered = 2
+)
+
+// An exchange for both the native and Go validators to validate. A response's method and uri are those of the request
+// it's a response to.
+type testExchange struct {
+	isResponse  bool
+	statusCode  int
+	method      string
+	uri         string
+	contentType string
+	body        []byte
+}
+
+// The bodies the fuzzed corpus is made from, which are valid for the operations they're used with
+var itemSeeds = [][]byte{
+	[]byte(`{"name":"ab","count":5}`),
+	[]byte(`{"name":"abcde","count":99,"price":-1.5,"tags":["a","bé"],"flag":null,"any":{"q":[1,null]},"meta":{"x":3}}`),
+	[]byte(` { "count" : 0 , "name" : "💖xy" } `),
+	[]byte(`{"name":"ab","count":5,"flag":true}`),
+}
+var treeSeeds = [][]byte{
+	[]byte(`{"value":1,"children":[{"value":2},{"value":3,"children":[]}]}`),
+	[]byte(`{"value":-0}`),
+}
+var toggleSeeds = [][]byte{
+	[]byte(`{"mode":null}`),
+	[]byte(`{"mode":"on","plain":"x","label":null}`),
+	[]byte(`{"mode":"off","label":"a"}`),
+}
+var switchSeeds = [][]byte{
+	[]byte(`{"state":"on"}`),
+	[]byte(`{"state":"off","other":1}`),
+}
+
+// The operations in testdata/appspec.json the corpus exercises, and the bodies to mutate for each of them
+var testOperations = []struct {
+	isResponse bool
+	statusCode int
+	method     string
+	path       string
+	seeds      [][]byte
+}{
+	{method: "POST", path: "/items", seeds: itemSeeds},
+	{isResponse: true, statusCode: 201, method: "POST", path: "/items", seeds: itemSeeds},
+	{isResponse: true, statusCode: 200, method: "GET", path: "/items/42", seeds: treeSeeds},
+	{method: "POST", path: "/toggles", seeds: toggleSeeds},
+	{isResponse: true, statusCode: 200, method: "POST", path: "/toggles", seeds: toggleSeeds},
+	{method: "POST", path: "/switches", seeds: switchSeeds},
+	{method: "POST", path: "/notes", seeds: itemSeeds},
+}
+
+// The Content-Types exchanges are sent with besides application/json, which the Go validator matches exactly or by
+// what comes before their first ';'
+var mutatedContentTypes = []string{
+	"application/json; charset=utf-8", "application/json;charset=utf-8", "application/json;", "Application/JSON",
+	"APPLICATION/JSON; charset=utf-8", "application/json ", " application/json", "application/json ; charset=utf-8",
+	"\tapplication/json", "application/jsonp", "application/json-patch+json", "text/plain", "application/*", "",
+}
+
+// The fragments bodies are mutated with, which are chosen to straddle the bounds in testdata/appspec.json and to break
+// JSON's syntax in the ways the native validators' scanner has to handle
+var mutationTokens = []string{
+	`null`, `0`, `-1`, `1.5`, `100`, `99`, `2147483648`, `1e400`, `1e1`, `"`, `""`, `"a"`, `"abcdef"`, `true`, `false`,
+	`[]`, `{}`, `,`, `:`, `}`, `]`, `[`, `{`, ` `, `A`, `\`, "\x00", "\xff", "\xc3", `"bé"`, `"tags"`, `"name"`,
+	`"count"`, `01`, `-`, `1.`, `.5`, `1e`, `+1`, `"on"`, `"off"`, `"x"`, `"mode"`, `"plain"`, `"label"`, `"state"`,
+}
+
+// The number of exchanges in the fuzzed corpus
+const corpusSize = 40000
+
+// TestNativeValidatorsAgreeWithGoValidator generates native validators for testdata/appspec.json, then checks that
+// every exchange in a fuzzed corpus they find valid is also found valid by the Go validator
+func TestNativeValidatorsAgreeWithGoValidator(t *testing.T) {
+	if _, err := exec.LookPath("cc"); err != nil {
+		t.Skip("No C compiler to build the native validators with")
+	}
+
+	driverPath := buildNativeDriver(t)
+
+	corpus := fuzzCorpus(rand.New(rand.NewSource(1)))
+	nativeVerdicts := validateNatively(t, driverPath, corpus)
+
+	requestMiddleware, err := firetail.GetMiddleware(&firetail.Options{
+		OpenapiSpecPath:         testAppspecPath,
+		DebugErrs:               true,
+		EnableRequestValidation: true,
+	})
+	if err != nil {
+		t.Fatal("Failed to create request middleware, err:", err.Error())
+	}
+	responseMiddleware, err := firetail.GetMiddleware(&firetail.Options{
+		OpenapiSpecPath:          testAppspecPath,
+		DebugErrs:                true,
+		EnableResponseValidation: true,
+	})
+	if err != nil {
+		t.Fatal("Failed to create response middleware, err:", err.Error())
+	}
+
+	var covered, conservative int
+	for i, exchange := range corpus {
+		switch nativeVerdicts[i] {
+		case nativeNotCovered:
+			continue
+		case nativeValid:
+			covered++
+			if !validateWithGo(exchange, requestMiddleware, responseMiddleware) {
+				t.Errorf("Native validators found %s valid but the Go validator didn't", exchange)
+			}
+		case nativeInvalid:
+			// Anything the native validators find invalid is passed on to the Go validator, so they only have to
+			// agree when it's invalid for the native validators to save any time
+			covered++
+			if validateWithGo(exchange, requestMiddleware, responseMiddleware) {
+				conservative++
+			}
+		default:
+			t.Fatalf("Native validators gave an unknown verdict %d for %s", nativeVerdicts[i], exchange)
+		}
+	}
+	if covered == 0 {
+		t.Fatal("Native validators didn't cover any of the corpus")
+	}
+	t.Logf("Native validators covered %d of %d exchanges, and found %d of them invalid that the Go validator didn't",
+		covered, len(corpus), conservative)
+}
+
+// TestNativeValidatorsLeaveDivergencesToGo checks the native validators' verdicts for exchanges the Go validator
+// treats in ways they don't replicate, which they must leave to it, and for the nullable enums they do cover
+func TestNativeValidatorsLeaveDivergencesToGo(t *testing.T) {
+	if _, err := exec.LookPath("cc"); err != nil {
+		t.Skip("No C compiler to build the native validators with")
+	}
+
+	request := func(path, contentType, body string) *testExchange {
+		return &testExchange{method: "POST", uri: path, contentType: contentType, body: []byte(body)}
+	}
+	testCases := []struct {
+		exchange *testExchange
+		verdict  int
+	}{
+		{request("/items", "application/json", `{"name":"ab","count":5}`), nativeValid},
+		{request("/items", "application/json;charset=utf-8", `{"name":"ab","count":5}`), nativeValid},
+		{request("/items", "Application/JSON", `{"name":"ab","count":5}`), nativeNotCovered},
+		{request("/items", "application/json ; charset=utf-8", `{"name":"ab","count":5}`), nativeNotCovered},
+		{request("/items", "application/jsonp", `{"name":"ab","count":5}`), nativeNotCovered},
+		{request("/switches", "application/json", `{"state":null}`), nativeNotCovered},
+		{request("/notes", "application/json", `{"name":"ab","count":5}`), nativeNotCovered},
+		{request("/toggles", "application/json", `{"mode":null}`), nativeValid},
+		{request("/toggles", "application/json", `{"mode":"on","label":null}`), nativeValid},
+		{request("/toggles", "application/json", `{"mode":"up"}`), nativeInvalid},
+		{request("/toggles", "application/json", `{"mode":"on","plain":null}`), nativeInvalid},
+		{request("/toggles", "application/json", `{"mode":"on","plain":"y"}`), nativeInvalid},
+	}
+
+	corpus := make([]*testExchange, 0, len(testCases))
+	for _, testCase := range testCases {
+		corpus = append(corpus, testCase.exchange)
+	}
+	nativeVerdicts := validateNatively(t, buildNativeDriver(t), corpus)
+	for i, testCase := range testCases {
+		if nativeVerdicts[i] != testCase.verdict {
+			t.Errorf("Native validators gave verdict %d for %s with Content-Type %q, expected %d", nativeVerdicts[i],
+				testCase.exchange, testCase.exchange.contentType, testCase.verdict)
+		}
+	}
+}
+
+// buildNativeDriver generates native validators for testdata/appspec.json, and builds them with the native runtime
+// and testdata/native_driver.c into an executable in a temporary directory, returning its path
+func buildNativeDriver(t *testing.T) string {
+	specBytes, err := os.ReadFile(testAppspecPath)
+	if err != nil {
+		t.Fatal("Failed to read appspec, err:", err.Error())
+	}
+	doc, err := openapi3.NewLoader().LoadFromData(specBytes)
+	if err != nil {
+		t.Fatal("Failed to load appspec, err:", err.Error())
+	}
+	g := &generator{doc: doc, schemaIds: map[*openapi3.Schema]int{}}
+	source := g.generate(md5.Sum(specBytes))
+
+	dir := t.TempDir()
+	sourcePath := filepath.Join(dir, "native_validators.c")
+	if err := os.WriteFile(sourcePath, source, 0644); err != nil {
+		t.Fatal("Failed to write validators, err:", err.Error())
+	}
+
+	driverPath := filepath.Join(dir, "native_driver")
+	build := exec.Command("cc", "-O2", "-Wall", "-Werror", "-I", "../../native_validators", "-o", driverPath,
+		sourcePath, "../../native_validators/native_runtime.c", "testdata/native_driver.c", "-lm")
+	if output, err := build.CombinedOutput(); err != nil {
+		t.Fatalf("Failed to build native validators, err: %s\n%s", err.Error(), output)
+	}
+	return driverPath
+}
+
+// fuzzCorpus makes the seeds into requests and responses for the operations they're valid for, and mutates most of
+// their bodies and some of their paths & Content-Types
+func fuzzCorpus(rng *rand.Rand) []*testExchange {
+	corpus := make([]*testExchange, 0, corpusSize)
+	for i := 0; i < corpusSize; i++ {
+		operation := testOperations[i%len(testOperations)]
+		exchange := &testExchange{
+			isResponse:  operation.isResponse,
+			statusCode:  operation.statusCode,
+			method:      operation.method,
+			uri:         operation.path,
+			contentType: "application/json",
+			body:        operation.seeds[rng.Intn(len(operation.seeds))],
+		}
+		if i%10 != 0 {
+			exchange.body = mutate(rng, exchange.body)
+		}
+		if rng.Intn(4) == 0 {
+			exchange.contentType = mutatedContentTypes[rng.Intn(len(mutatedContentTypes))]
+		}
+		if rng.Intn(5) == 0 {
+			exchange.uri = mutatePath(rng, exchange.uri)
+		}
+		corpus = append(corpus, exchange)
+	}
+	return corpus
+}
+
+// mutatePath changes the path in one of the ways the Go validator's router might treat differently to the native
+// validators
+func mutatePath(rng *rand.Rand, path string) string {
+	switch rng.Intn(6) {
+	case 0:
+		return path + "/"
+	case 1:
+		return strings.ToUpper(path[:2]) + path[2:]
+	case 2:
+		i := 1 + rng.Intn(len(path)-1)
+		return fmt.Sprintf("%s%%%02X%s", path[:i], path[i], path[i+1:])
+	case 3:
+		return path + "?x=1"
+	case 4:
+		return path + "?"
+	default:
+		return "/" + path
+	}
+}
+
+// mutate makes one to three random insertions, deletions, replacements or truncations to a copy of body
+func mutate(rng *rand.Rand, body []byte) []byte {
+	mutated := append([]byte{}, body...)
+	for n := rng.Intn(3) + 1; n > 0; n-- {
+		i := rng.Intn(len(mutated) + 1)
+		token := mutationTokens[rng.Intn(len(mutationTokens))]
+		switch rng.Intn(5) {
+		case 0:
+			if i < len(mutated) {
+				mutated = append(mutated[:i], mutated[i+1:]...)
+			}
+		case 1:
+			mutated = append(mutated[:i], append([]byte(token), mutated[i:]...)...)
+		case 2:
+			j := i + rng.Intn(len(mutated)-i+1)
+			mutated = append(mutated[:i], append([]byte(token), mutated[j:]...)...)
+		case 3:
+			mutated = mutated[:i]
+		case 4:
+			if i < len(mutated) {
+				mutated[i] = byte(rng.Intn(256))
+			}
+		}
+	}
+	return mutated
+}
+
+// validateNatively passes the corpus through the native driver, and returns its verdicts in the same order
+func validateNatively(t *testing.T, driverPath string, corpus []*testExchange) []int {
+	var input bytes.Buffer
+	for _, exchange := range corpus {
+		kind := "request"
+		if exchange.isResponse {
+			kind = "response"
+		}
+		fmt.Fprintf(&input, "%s %d %s x%s x%s x%s\n", kind, exchange.statusCode, exchange.method,
+			hex.EncodeToString([]byte(exchange.uri)), hex.EncodeToString([]byte(exchange.contentType)),
+			hex.EncodeToString(exchange.body))
+	}
+
+	driver := exec.Command(driverPath)
+	driver.Stdin = &input
+	driver.Stderr = os.Stderr
+	output, err := driver.Output()
+	if err != nil {
+		t.Fatal("Native driver failed, err:", err.Error())
+	}
+
+	verdicts := make([]int, 0, len(corpus))
+	scanner := bufio.NewScanner(bytes.NewReader(output))
+	for scanner.Scan() {
+		verdict, err := strconv.Atoi(scanner.Text())
+		if err != nil {
+			t.Fatal("Native driver gave a malformed verdict, err:", err.Error())
+		}
+		verdicts = append(verdicts, verdict)
+	}
+	if len(verdicts) != len(corpus) {
+		t.Fatalf("Native driver gave %d verdicts for %d exchanges", len(verdicts), len(corpus))
+	}
+	return verdicts
+}
+
+// validateWithGo returns whether the Go validator finds the exchange valid, judging it the same way the validator's
+// ValidateRequestBody and ValidateResponseBody do: it's invalid if the middleware changes what the backend responds
+func validateWithGo(
+	exchange *testExchange, requestMiddleware, responseMiddleware func(next http.Handler) http.Handler,
+) bool {
+	placeholderResponse := []byte("request validated")
+	backend := &testBackend{statusCode: 200, contentType: "text/plain", body: placeholderResponse}
+	middleware := requestMiddleware
+	var requestBody io.Reader = bytes.NewReader(exchange.body)
+	if exchange.isResponse {
+		backend = &testBackend{statusCode: exchange.statusCode, contentType: exchange.contentType, body: exchange.body}
+		middleware = responseMiddleware
+		requestBody = strings.NewReader("")
+	}
+
+	request := httptest.NewRequest(exchange.method, exchange.uri, requestBody)
+	if !exchange.isResponse {
+		request.Header.Set("Content-Type", exchange.contentType)
+	}
+	recorder := httptest.NewRecorder()
+	middleware(backend).ServeHTTP(recorder, request)
+
+	return recorder.Code == backend.statusCode && bytes.Equal(recorder.Body.Bytes(), backend.body)
+}
+
+type testBackend struct {
+	statusCode  int
+	contentType string
+	body        []byte
+}
+
+func (b *testBackend) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	w.Header().Set("Content-Type", b.contentType)
+	w.WriteHeader(b.statusCode)
+	w.Write(b.body)
+}
+
+func (e *testExchange) String() string {
+	kind := "request"
+	if e.isResponse {
+		kind = fmt.Sprintf("%d response", e.statusCode)
+	}
+	return fmt.Sprintf("%s to %s %s with body %q", kind, e.method, e.uri, e.body)
+}
@@ -0,0 +1,91 @@
+// Validates exchanges read from stdin with the native validators it's linked with, and writes each verdict to stdout on
+// a line of its own, so the codegen tests can compare them with the Go validator's. Each exchange is a line of:
+//
+//	request|response <status code> <method> x<uri as hex> x<content type as hex> x<body as hex>
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "native_runtime.h"
+
+int FiretailNativeValidateRequest(const char *method, size_t method_length, const char *uri, size_t uri_length,
+                                  const char *content_type, size_t content_type_length, const char *body,
+                                  size_t body_length, const char **operation_id);
+int FiretailNativeValidateResponse(const char *method, size_t method_length, const char *uri, size_t uri_length,
+                                   int status_code, const char *content_type, size_t content_type_length,
+                                   const char *body, size_t body_length);
+
+static int FiretailHexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Decodes the hex field starting at *position, which is preceded by an 'x' and followed by a space or the end of the
+// line, into decoded. Returns its length, or -1 if it's malformed.
+static long FiretailDecodeHexField(char **position, char *decoded) {
+  char *hex = *position;
+  if (*hex++ != 'x') {
+    return -1;
+  }
+  long length = 0;
+  for (; *hex != ' ' && *hex != '\n' && *hex != '\0'; hex += 2) {
+    int high = FiretailHexDigit(hex[0]), low = high < 0 ? -1 : FiretailHexDigit(hex[1]);
+    if (high < 0 || low < 0) {
+      return -1;
+    }
+    decoded[length++] = (char)(high << 4 | low);
+  }
+  *position = *hex == ' ' ? hex + 1 : hex;
+  return length;
+}
+
+int main(void) {
+  char *line = NULL;
+  size_t line_capacity = 0;
+  ssize_t line_length;
+  while ((line_length = getline(&line, &line_capacity, stdin)) > 0) {
+    char kind[16], method[16];
+    int status_code, fields_offset = -1;
+    if (sscanf(line, "%15s %d %15s %n", kind, &status_code, method, &fields_offset) != 3 || fields_offset < 0) {
+      fprintf(stderr, "Malformed exchange: %s", line);
+      return 1;
+    }
+
+    // The fields are each decoded into a buffer as long as the line, as they're never longer than their hex
+    char *position = line + fields_offset;
+    char *uri = malloc(line_length), *content_type = malloc(line_length), *body = malloc(line_length);
+    if (uri == NULL || content_type == NULL || body == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+    }
+    long uri_length = FiretailDecodeHexField(&position, uri);
+    long content_type_length = uri_length < 0 ? -1 : FiretailDecodeHexField(&position, content_type);
+    long body_length = content_type_length < 0 ? -1 : FiretailDecodeHexField(&position, body);
+    if (body_length < 0) {
+      fprintf(stderr, "Malformed exchange: %s", line);
+      return 1;
+    }
+
+    int result;
+    if (strcmp(kind, "request") == 0) {
+      const char *operation_id = NULL;
+      result = FiretailNativeValidateRequest(method, strlen(method), uri, uri_length, content_type,
+                                             content_type_length, body, body_length, &operation_id);
+    } else {
+      result = FiretailNativeValidateResponse(method, strlen(method), uri, uri_length, status_code, content_type,
+                                              content_type_length, body, body_length);
+    }
+    printf("%d\n", result);
+    free(uri);
+    free(content_type);
+    free(body);
+  }
+  free(line);
+  return 0;
+}
@@ -2,10 +2,12 @@ module firetail-validator
 
 go 1.20
 
-require github.com/FireTail-io/firetail-go-lib v0.0.0
+require (
+	github.com/FireTail-io/firetail-go-lib v0.0.0
+	github.com/getkin/kin-openapi v0.110.0
+)
 
 require (
-	github.com/getkin/kin-openapi v0.110.0 // indirect
 	github.com/go-openapi/jsonpointer v0.19.5 // indirect
 	github.com/go-openapi/swag v0.22.3 // indirect
 	github.com/gorilla/mux v1.8.0 // indirect
@@ -2,8 +2,8 @@ package main
 
 import (
 	"C"
-	"encoding/json"
 	"log"
+	"runtime/cgo"
 	"strings"
 	"unsafe"
 
@@ -19,9 +19,6 @@ import (
 	"strconv"
 )
 
-var firetailRequestMiddleware func(next http.Handler) http.Handler
-var firetailResponseMiddleware func(next http.Handler) http.Handler
-
 //export ValidateRequestBody
 func ValidateRequestBody(
 	allowUndefinedRoutes unsafe.Pointer, allowUndefinedRoutesLength C.int,
@@ -29,9 +26,12 @@ func ValidateRequestBody(
 	pathCharPtr unsafe.Pointer, pathLength C.int,
 	methodCharPtr unsafe.Pointer, methodLength C.int,
 	headersCharPtr unsafe.Pointer, headersLength C.int,
-) (C.int, *C.char) {
-	// Create the middleware if it hasn't already been done
-	if firetailRequestMiddleware == nil {
+	loggedHeadersCharPtr unsafe.Pointer, loggedHeadersLength C.int,
+	loggedBodyLength C.int,
+) (C.int, *C.char, *C.char, uintptr) {
+	// Get the current appspec, creating the middleware if it hasn't already been done. The appspec may be reloaded
+	// while we're validating, so we only load it once.
+	spec, err := getRequestAppspec(func() *firetail.Options {
 		allowUndefinedRoutesBool, err := strconv.ParseBool(
 			string(C.GoBytes(allowUndefinedRoutes, allowUndefinedRoutesLength)),
 		)
@@ -39,20 +39,20 @@ func ValidateRequestBody(
 			log.Println("Failed to initialise Firetail middleware, err:", err.Error())
 		}
 
-		firetailRequestMiddleware, err = firetail.GetMiddleware(&firetail.Options{
-			OpenapiSpecPath:          "/etc/nginx/appspec.yml",
+		return &firetail.Options{
+			OpenapiSpecPath:          appspecPath,
 			LogsApiToken:             "",
 			LogsApiUrl:               "",
 			DebugErrs:                true,
 			EnableRequestValidation:  true,
 			EnableResponseValidation: false,
 			AllowUndefinedRoutes:     allowUndefinedRoutesBool,
-		})
-		if err != nil {
-			log.Println("Failed to initialise Firetail middleware, err:", err.Error())
-			// return 1 is error by convention
-			return 1, nil
 		}
+	})
+	if err != nil {
+		log.Println("Failed to initialise Firetail middleware, err:", err.Error())
+		// return 1 is error by convention
+		return 1, nil, nil, 0
 	}
 
 	// Create a fake handler
@@ -63,26 +63,23 @@ func ValidateRequestBody(
 	}
 
 	// Create our middleware instance with the stub handler
-	myMiddleware := firetailRequestMiddleware(myHandler)
+	myMiddleware := spec.requestMiddleware(myHandler)
 
 	// Create a local response writer to record what the middleware says we should respond with
 	localResponseWriter := httptest.NewRecorder()
 
 	// Create the go request object we'll pass to the middleware
-	mockRequest := httptest.NewRequest(
-		string(C.GoBytes(methodCharPtr, methodLength)),
-		string(C.GoBytes(pathCharPtr, pathLength)),
-		io.NopCloser(bytes.NewBuffer(C.GoBytes(bodyCharPtr, bodyLength))),
-	)
-	// Add the headers to the mock request
-	var headers map[string][]string
-	if err := json.Unmarshal(C.GoBytes(headersCharPtr, headersLength), &headers); err != nil {
-		panic(err)
-	}
-	for k, v := range headers {
-		// convert value (v) to comma-delimited values. key "k" is still as it is
-		mockRequest.Header.Add(k, strings.Join(v[:], ", "))
+	request := &exchangeRequest{
+		method:  string(C.GoBytes(methodCharPtr, methodLength)),
+		path:    string(C.GoBytes(pathCharPtr, pathLength)),
+		body:    C.GoBytes(bodyCharPtr, bodyLength),
+		headers: parseRequestHeaders(headersCharPtr, headersLength),
 	}
+	mockRequest := httptest.NewRequest(request.method, request.path, io.NopCloser(bytes.NewBuffer(request.body)))
+	mockRequest.Header = request.headers
+
+	// Find the operation the request matches, for the $firetail_operation_id variable
+	operationIdCString := spec.getOperationId(mockRequest)
 
 	// Serve the request to the middlware
 	myMiddleware.ServeHTTP(localResponseWriter, mockRequest)
@@ -91,15 +88,24 @@ func ValidateRequestBody(
 	middlewareResponseBodyBytes, err := io.ReadAll(localResponseWriter.Body)
 	responseCString := C.CString(string(middlewareResponseBodyBytes))
 	if err != nil {
-		return 1, responseCString // return 1 is error by convention
+		return 1, responseCString, operationIdCString, 0 // return 1 is error by convention
 	}
 
 	// If the body differs after being passed through the middleware then we'll just infer it doesn't match the spec
 	if string(middlewareResponseBodyBytes) != string(placeholderResponse) {
-		return 1, responseCString // return 1 is error by convention
+		return 1, responseCString, operationIdCString, 0 // return 1 is error by convention
 	}
 
-	return 0, responseCString // return 0 is success by convention
+	// Keep the request in full so ValidateResponseBody can validate the response against it, along with what nginx's
+	// capture policy allows to be logged. If nginx doesn't give us separate headers to log then they're the same as the
+	// ones we've already parsed.
+	request.loggedBodyLength = int(loggedBodyLength)
+	request.loggedHeaders = request.headers
+	if loggedHeadersCharPtr != nil {
+		request.loggedHeaders = parseRequestHeaders(loggedHeadersCharPtr, loggedHeadersLength)
+	}
+
+	return 0, responseCString, operationIdCString, uintptr(cgo.NewHandle(request)) // return 0 is success by convention
 }
 
 //export ValidateResponseBody
@@ -108,15 +114,21 @@ func ValidateResponseBody(
 	urlLength C.int,
 	tokenCharPtr unsafe.Pointer, tokenLength C.int,
 	allowUndefinedRoutes unsafe.Pointer, allowUndefinedRoutesLength C.int,
+	requestHandle uintptr,
 	reqBodyCharPtr unsafe.Pointer, reqBodyLength C.int,
 	reqHeadersJsonCharPtr unsafe.Pointer, reqHeadersJsonLength C.int,
 	resBodyCharPtr unsafe.Pointer, resBodyLength C.int,
+	loggedResBodyLength C.int,
 	resHeadersJsonCharPtr unsafe.Pointer, resHeadersJsonLength C.int,
+	loggedResHeadersJsonCharPtr unsafe.Pointer, loggedResHeadersJsonLength C.int,
 	pathCharPtr unsafe.Pointer, pathLength C.int,
 	statusCode C.int,
 	methodCharPtr unsafe.Pointer, methodLength C.int,
+	responseValidated C.int,
 ) (C.int, *C.char) {
-	if firetailResponseMiddleware == nil {
+	// Get the current appspec, creating the middleware if it hasn't already been done. The appspec may be reloaded
+	// while we're validating, so we only load it once.
+	spec, err := getResponseAppspec(func() *firetail.Options {
 		allowUndefinedRoutesBool, err := strconv.ParseBool(
 			string(C.GoBytes(allowUndefinedRoutes, allowUndefinedRoutesLength)),
 		)
@@ -124,62 +136,93 @@ func ValidateResponseBody(
 			log.Println("Failed to initialise Firetail middleware, err:", err.Error())
 		}
 
-		firetailResponseMiddleware, err = firetail.GetMiddleware(&firetail.Options{
-			OpenapiSpecPath:          "/etc/nginx/appspec.yml",
+		return &firetail.Options{
+			OpenapiSpecPath:          appspecPath,
 			LogsApiToken:             strings.TrimSpace(string(C.GoBytes(tokenCharPtr, tokenLength))),
 			LogsApiUrl:               strings.TrimSpace(string(C.GoBytes(urlCharPtr, urlLength))),
 			DebugErrs:                true,
 			EnableRequestValidation:  false,
 			EnableResponseValidation: true,
 			AllowUndefinedRoutes:     allowUndefinedRoutesBool,
-		})
-		if err != nil {
-			log.Println("Failed to initialise Firetail middleware, err:", err.Error())
-			return 0, nil
 		}
+	})
+	if err != nil {
+		log.Println("Failed to initialise Firetail middleware, err:", err.Error())
+		return 0, nil
 	}
 
-	// Create a handler returning the response body and status code from nginx
-	var responseHeaders map[string]string
-	if resHeadersJsonCharPtr != nil {
-		if err := json.Unmarshal(C.GoBytes(resHeadersJsonCharPtr, resHeadersJsonLength), &responseHeaders); err != nil {
-			panic(err)
-		}
-	} else {
-		responseHeaders = make(map[string]string)
+	// The response headers are validated in full, and logged with nginx's capture policy applied. If nginx doesn't
+	// give us separate headers to log then they're the same.
+	responseHeaders := parseResponseHeaders(resHeadersJsonCharPtr, resHeadersJsonLength)
+	loggedResponseHeaders := responseHeaders
+	if loggedResHeadersJsonCharPtr != nil {
+		loggedResponseHeaders = parseResponseHeaders(loggedResHeadersJsonCharPtr, loggedResHeadersJsonLength)
 	}
 	resBodySlice := C.GoBytes(resBodyCharPtr, resBodyLength)
-	myHandler := &stubHandler{
-		responseCode:    int(statusCode),
-		responseBytes:   resBodySlice,
-		responseHeaders: responseHeaders,
-	}
 
-	// Create our middleware instance with the stub handler
-	myMiddleware := firetailResponseMiddleware(myHandler)
+	// Get the request, reusing the one ValidateRequestBody kept for us if nginx gave us a handle to it. Otherwise nginx
+	// gives us the request's body & headers to log, which the response is validated against too.
+	var request *exchangeRequest
+	if requestHandle != 0 {
+		request = cgo.Handle(requestHandle).Value().(*exchangeRequest)
+	} else {
+		request = &exchangeRequest{
+			method:  string(C.GoBytes(methodCharPtr, methodLength)),
+			path:    string(C.GoBytes(pathCharPtr, pathLength)),
+			body:    C.GoBytes(reqBodyCharPtr, reqBodyLength),
+			headers: http.Header{},
+		}
+		if reqHeadersJsonCharPtr != nil {
+			request.headers = parseRequestHeaders(reqHeadersJsonCharPtr, reqHeadersJsonLength)
+		}
+		request.loggedBodyLength = len(request.body)
+		request.loggedHeaders = request.headers
+	}
 
-	// Create a local response writer to record what the middleware says we should respond with
-	localResponseWriter := httptest.NewRecorder()
+	// Validate the response, unless nginx's native validators have already found it valid
+	var result C.int
+	var responseCString *C.char
+	if responseValidated == 0 {
+		result, responseCString = validateResponse(spec, request, int(statusCode), resBodySlice, responseHeaders)
+	}
 
-	// Create the go request object we'll pass to the middleware
-	mockRequest := httptest.NewRequest(
-		string(C.GoBytes(methodCharPtr, methodLength)), string(C.GoBytes(pathCharPtr, pathLength)),
-		io.NopCloser(bytes.NewBuffer(C.GoBytes(reqBodyCharPtr, reqBodyLength))),
-	)
-	// Add the headers to the mock request
-	if reqHeadersJsonCharPtr != nil {
-		var headers map[string][]string
-		if err := json.Unmarshal(C.GoBytes(reqHeadersJsonCharPtr, reqHeadersJsonLength), &headers); err != nil {
-			panic(err)
-		}
-		for k, v := range headers {
-			// convert value (v) to comma-delimited values. key "k" is still as it is
-			mockRequest.Header.Add(k, strings.Join(v[:], ", "))
+	// Log the exchange, if there's an API token to log it with. The response body is logged cut to nginx's capture
+	// policy, like the request body.
+	if spec.responseLoggingMiddleware != nil {
+		loggedResBodySlice := resBodySlice
+		if int(loggedResBodyLength) < len(resBodySlice) {
+			loggedResBodySlice = resBodySlice[:loggedResBodyLength]
 		}
+		loggingMiddleware := spec.responseLoggingMiddleware(&stubHandler{
+			responseCode:    int(statusCode),
+			responseBytes:   loggedResBodySlice,
+			responseHeaders: loggedResponseHeaders,
+		})
+		loggingMiddleware.ServeHTTP(httptest.NewRecorder(), request.newLoggedRequest())
+	}
+
+	if result != 0 {
+		return result, responseCString
 	}
+	return 0, C.CString(string(resBodySlice)) // return 0 is success by convention
+}
+
+// validateResponse passes the response through the response middleware, which only validates it. If it's invalid it
+// returns 1 and the response the middleware gave instead.
+func validateResponse(
+	spec *appspec, request *exchangeRequest, statusCode int, body []byte, headers map[string]string,
+) (C.int, *C.char) {
+	myMiddleware := spec.responseMiddleware(&stubHandler{
+		responseCode:    statusCode,
+		responseBytes:   body,
+		responseHeaders: headers,
+	})
+
+	// Create a local response writer to record what the middleware says we should respond with
+	localResponseWriter := httptest.NewRecorder()
 
 	// Serve the request to the middlware
-	myMiddleware.ServeHTTP(localResponseWriter, mockRequest)
+	myMiddleware.ServeHTTP(localResponseWriter, request.newRequest())
 
 	// for profiling the CPU, uncomment this and run
 	// go tool pprof http://localhost:6060/debug/pprof/profile\?seconds\=30
@@ -190,17 +233,13 @@ func ValidateResponseBody(
 	// If the response code or body differs after being passed through the middleware then we'll just infer it doesn't
 	// match the spec
 	middlewareResponseBodyBytes, err := io.ReadAll(localResponseWriter.Body)
-	responseCString := C.CString(string(middlewareResponseBodyBytes))
 	if err != nil {
-		return 1, responseCString // return 1 is error by convention
+		return 1, C.CString(string(middlewareResponseBodyBytes)) // return 1 is error by convention
 	}
-
-	// If the body differs after being passed through the middleware then we'll just infer it doesn't match the spec
-	if string(middlewareResponseBodyBytes) != string(resBodySlice) || localResponseWriter.Code != int(statusCode) {
-		return 1, responseCString // return 1 is error by convention
+	if string(middlewareResponseBodyBytes) != string(body) || localResponseWriter.Code != statusCode {
+		return 1, C.CString(string(middlewareResponseBodyBytes)) // return 1 is error by convention
 	}
-
-	return 0, C.CString(string(resBodySlice)) // return 0 is success by convention
+	return 0, nil
 }
 
 func main() {}
@@ -0,0 +1,78 @@
+package main
+
+import (
+	"C"
+	"bytes"
+	"encoding/json"
+	"io"
+	"net/http"
+	"net/http/httptest"
+	"runtime/cgo"
+	"strings"
+	"unsafe"
+)
+
+// exchangeRequest holds the parts of a request ValidateRequestBody has already copied & parsed, so that
+// ValidateResponseBody can rebuild it without nginx passing the request's body & headers across again. nginx holds it
+// by a cgo.Handle until it calls ReleaseRequest.
+type exchangeRequest struct {
+	method  string
+	path    string
+	body    []byte
+	headers http.Header
+	// How much of the body to log, and the headers to log, with nginx's capture policy applied
+	loggedBodyLength int
+	loggedHeaders    http.Header
+}
+
+// newRequest creates the request in full, for the response to be validated against
+func (r *exchangeRequest) newRequest() *http.Request {
+	request := httptest.NewRequest(r.method, r.path, io.NopCloser(bytes.NewReader(r.body)))
+	request.Header = r.headers
+	return request
+}
+
+// newLoggedRequest creates the request with the body & headers that should be logged, for the response logging
+// middleware
+func (r *exchangeRequest) newLoggedRequest() *http.Request {
+	body := r.body
+	if r.loggedBodyLength < len(body) {
+		body = body[:r.loggedBodyLength]
+	}
+	request := httptest.NewRequest(r.method, r.path, io.NopCloser(bytes.NewReader(body)))
+	request.Header = r.loggedHeaders
+	return request
+}
+
+// parseRequestHeaders parses the request headers JSON given to us by nginx, which maps each header's name to a list
+// of its values
+func parseRequestHeaders(headersCharPtr unsafe.Pointer, headersLength C.int) http.Header {
+	var headers map[string][]string
+	if err := json.Unmarshal(C.GoBytes(headersCharPtr, headersLength), &headers); err != nil {
+		panic(err)
+	}
+	parsedHeaders := http.Header{}
+	for k, v := range headers {
+		// convert value (v) to comma-delimited values. key "k" is still as it is
+		parsedHeaders.Add(k, strings.Join(v[:], ", "))
+	}
+	return parsedHeaders
+}
+
+// parseResponseHeaders parses the response headers JSON given to us by nginx, which maps each header's name to its
+// value
+func parseResponseHeaders(headersCharPtr unsafe.Pointer, headersLength C.int) map[string]string {
+	headers := map[string]string{}
+	if headersCharPtr == nil {
+		return headers
+	}
+	if err := json.Unmarshal(C.GoBytes(headersCharPtr, headersLength), &headers); err != nil {
+		panic(err)
+	}
+	return headers
+}
+
+//export ReleaseRequest
+func ReleaseRequest(requestHandle uintptr) {
+	cgo.Handle(requestHandle).Delete()
+}